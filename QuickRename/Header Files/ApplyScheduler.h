@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Config.h>
+#include <chrono>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+// Runs rename and delete operations with an adaptive number of operations in flight.
+// The window grows by one operation per round trip while latency stays under the target
+// and is halved when an operation is slow or fails with a transient error (busy file,
+// sharing violation, network timeout), which is then retried after an exponential backoff.
+// The window carries over from one run() to the next, so batches keep what earlier ones learned.
+class ApplyScheduler {
+public:
+    // An operation returns an empty error code on success.
+    using Operation = std::function<std::error_code()>;
+
+    struct Result {
+        size_t succeeded = 0;
+        size_t failed = 0;
+        size_t retried = 0;
+        int peakConcurrency = 0;
+        double averageLatencyMs = 0;
+        std::vector<std::pair<size_t, std::error_code>> failures;
+    };
+
+    ApplyScheduler(const Config::ApplyConcurrency& limits);
+
+    // Runs all operations and returns once every one has succeeded or given up. Not to be called
+    // from several threads at once.
+    Result run(const std::vector<Operation>& operations);
+
+    // Returns true if the error is worth retrying after backing off.
+    static bool isTransientError(const std::error_code& ec);
+
+private:
+    const Config::ApplyConcurrency& limits;
+    double window;
+    std::chrono::steady_clock::time_point lastDecrease{};
+};
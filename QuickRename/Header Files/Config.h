@@ -32,6 +32,25 @@ public:
 
 class Config {
 
+public:
+    // Order in which files are numbered, None keeps directory iteration order.
+    enum class SortOrder { None, Natural, Lexicographic, MTime, Size, Capture };
+
+    // Which file of a group with identical content is kept, None disables duplicate deletion.
+    enum class DuplicatePolicy { None, KeepOldest, KeepShortestName };
+
+    // Bounds for the number of renames and deletions in flight while applying changes.
+    struct ApplyConcurrency {
+        int min;
+        int max;
+        int latencyTargetMs;
+        int retries;
+        ApplyConcurrency() : min(1), max(1), latencyTargetMs(50), retries(0) {}
+    };
+
+    // How the target is split between worker processes, None plans and applies in this process.
+    enum class ShardMode { None, NameHash, Subdirectory };
+
 private:
     struct StrAddPatternConfig {
         std::string match;
@@ -42,8 +61,10 @@ private:
             FormatConfig() : start(1), step(1) {}
         } formatConfig;
         int position;
+        SortOrder sort;
+        std::string sortMatch;
 
-        StrAddPatternConfig() : position(0) {}
+        StrAddPatternConfig() : position(0), sort(SortOrder::None) {}
     };
     std::string targetDir;
     std::vector<std::string> unwantedExtensionList;
@@ -51,6 +72,14 @@ private:
     std::vector<std::pair<std::string, std::string>> stringReplaceList;
 
     StrAddPatternConfig stringAddPattern;
+    DuplicatePolicy duplicatePolicy = DuplicatePolicy::None;
+    bool unicodeNormalize{};
+    bool ignoreCase{};
+    ApplyConcurrency applyConcurrency;
+    size_t planMemoryBudget{};
+    std::string spillDir;
+    ShardMode shardMode = ShardMode::None;
+    int shardCount{};
 
 public:
     Config(const json& profile);
@@ -59,9 +88,19 @@ public:
     const std::vector<std::string>& getStringDeleteList() const;
     const std::vector<std::pair<std::string, std::string>>& getStringReplaceList() const;
     const StrAddPatternConfig& getStringAddPattern() const;
+    DuplicatePolicy getDuplicatePolicy() const;
+    const ApplyConcurrency& getApplyConcurrency() const;
+    size_t getPlanMemoryBudget() const;
+    const std::string& getSpillDir() const;
+    ShardMode getShardMode() const;
+    int getShardCount() const;
 
     bool isUnwantedExtensionListEmpty() const;
+    bool isDeleteDuplicatesEmpty() const;
     bool isStringDeleteListEmpty() const;
     bool isStringReplacePatternEmpty() const;
     bool isStringAddPatternEmpty() const;
+    bool isUnicodeNormalizeEnabled() const;
+    bool isIgnoreCaseEnabled() const;
+    bool isShardingEnabled() const;
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Entry of a spill file. Records are ordered by key, then by source.
+struct SpillRecord {
+    std::string key;
+    std::string source;
+    std::string target;
+
+    bool operator<(const SpillRecord& other) const;
+};
+
+// Sequential writer for a file of length prefixed records.
+class RunWriter {
+private:
+    std::ofstream stream;
+
+public:
+    RunWriter(const std::filesystem::path& path);
+    void write(const SpillRecord& record);
+    void close();
+};
+
+// Sequential reader for files created by RunWriter.
+class RunReader {
+private:
+    std::ifstream stream;
+
+public:
+    RunReader(const std::filesystem::path& path);
+    // Returns false at the end of the file.
+    bool read(SpillRecord& record);
+};
+
+// Sorts more records than fit in memory.
+// Records are buffered until the memory budget is used up, then written as a sorted run.
+// merge() combines all runs with a k-way merge; runs are merged in several passes if there
+// are more of them than files that may be open at once.
+class ExternalSorter {
+private:
+    std::filesystem::path directory;
+    std::string prefix;
+    size_t memoryBudget;
+    size_t bufferBytes = 0;
+    size_t runCount = 0;
+    std::vector<SpillRecord> buffer;
+    std::vector<std::filesystem::path> runs;
+
+    std::filesystem::path nextRunPath();
+    void spill();
+    std::filesystem::path mergeRuns(const std::vector<std::filesystem::path>& inputs, const std::function<void(const SpillRecord&)>& visit);
+
+public:
+    ExternalSorter(const std::filesystem::path& directory, const std::string& prefix, size_t memoryBudget);
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(SpillRecord record);
+
+    // Calls 'visit' for every record in sorted order. Can be called more than once.
+    void merge(const std::function<void(const SpillRecord&)>& visit);
+};
@@ -25,5 +25,9 @@ public:
     std::filesystem::path get_new_name_path() const;
 
     bool is_name_changed() const;
-    bool applyNewName();
-};
\ No newline at end of file
+};
+
+// Renames 'from' to 'to' unless 'to' exists, in which case 'ec' is set to std::errc::file_exists.
+// Checking and renaming is one operation where the file system supports it, elsewhere the target is
+// checked right before a plain rename.
+void renameNoReplace(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& ec);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+
+// Streaming 64-bit content hash (xxHash64 construction).
+// Input is consumed in 32-byte stripes by four independent lanes. Used for short inputs.
+class ContentHash {
+private:
+    std::uint64_t lanes[4];
+    unsigned char buffer[32];
+    size_t bufferSize;
+    std::uint64_t totalLength;
+
+public:
+    ContentHash(std::uint64_t seed = 0);
+
+    void update(const unsigned char* data, size_t length);
+    std::uint64_t digest() const;
+};
+
+// Streaming 64-bit hash for whole files (XXH3 construction), the digest equals XXH3_64bits for
+// inputs longer than 240 bytes. Every 64-byte stripe feeds eight accumulators through 32x32->64 bit
+// multiplies, which run two lanes per instruction with SSE2 where available. Shorter inputs fall
+// back to ContentHash.
+class WideContentHash {
+private:
+    alignas(16) std::uint64_t accumulators[8];
+    unsigned char buffer[256];
+    unsigned char lastStripe[64];
+    size_t bufferSize;
+    size_t stripesInBlock;
+    std::uint64_t totalLength;
+
+public:
+    WideContentHash();
+
+    void update(const unsigned char* data, size_t length);
+    std::uint64_t digest() const;
+};
+
+// Hashes the first and last block of a file, files of up to two blocks are hashed completely.
+std::uint64_t hashFileBlocks(const std::filesystem::path& path, std::uint64_t size, std::error_code& ec);
+
+// Hashes the whole file content using large sequential reads.
+std::uint64_t hashFile(const std::filesystem::path& path, std::error_code& ec);
+
+// Compares two files byte by byte. Returns false if either file can't be read.
+bool isSameContent(const std::filesystem::path& first, const std::filesystem::path& second);
+
+// Size of the block read from each end of a file by hashFileBlocks.
+inline constexpr std::uint64_t partialHashBlockSize = 4096;
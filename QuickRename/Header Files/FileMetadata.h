@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <cstdint>
+
+// Metadata fields that can be requested from queryFileMetadata, combined as a bit mask.
+enum MetadataField : unsigned {
+    MetadataNone = 0,
+    MetadataSize = 1 << 0,
+    MetadataMTime = 1 << 1,
+    MetadataCTime = 1 << 2,
+    MetadataInode = 1 << 3,
+};
+
+// Times are nanoseconds since the Unix epoch. ctime is the creation time on Windows
+// and the status change time elsewhere, as reported by the platform.
+struct FileMetadata {
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    std::int64_t ctime = 0;
+    std::uint64_t inode = 0;
+};
+
+// Fetches only the requested fields with the cheapest call the platform offers.
+// Returns false if the file can't be queried, only the requested fields are guaranteed to be set.
+bool queryFileMetadata(const std::filesystem::path& path, unsigned fields, FileMetadata& metadata);
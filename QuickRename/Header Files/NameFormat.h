@@ -0,0 +1,39 @@
+#pragma once
+
+#include <File.h>
+#include <FileMetadata.h>
+#include <vector>
+
+// Compiled form of the string add pattern 'format'.
+// Supported tokens, all delimited by backslashes:
+//   \N\                 sequence number padded to N digits
+//   \mtime\ \ctime\     modification / creation date as "%Y-%m-%d", \mtime:%Y%m%d\ sets the format
+//   \size\              file size in bytes
+//   \parent\            name of the parent directory
+//   \inode\             file index (inode number)
+// Anything else is copied literally.
+class NameFormat {
+private:
+    enum class SegmentType { Literal, Counter, MTime, CTime, Size, Parent, Inode };
+
+    struct Segment {
+        SegmentType type;
+        std::string text;   // Literal text or date format
+        int width = 0;      // Counter width
+    };
+
+    std::vector<Segment> segments;
+    unsigned requiredFields = MetadataNone;
+    bool counter = false;
+
+    void addLiteral(const std::string& text);
+
+public:
+    NameFormat(const std::string& format);
+
+    // Metadata fields referenced by the format, MetadataNone if no file needs to be queried.
+    unsigned getRequiredFields() const;
+    bool hasCounter() const;
+
+    std::string render(const File& file, const FileMetadata& metadata, int number) const;
+};
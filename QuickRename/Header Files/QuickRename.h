@@ -3,5 +3,6 @@
 #include <Config.h>
 #include <File.h>
 #include <TaskHandler.h>
+#include <ShardCoordinator.h>
 
 inline std::string self_file_name;
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Config.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Command line argument that starts QuickRename as a worker process of a coordinator.
+inline const std::string shardWorkerArgument = "--shard-worker";
+
+// Coordinator mode for huge targets, used instead of TaskHandler if a profile sets "shards".
+// The coordinator lists the target directory and its subdirectories once and splits the files into
+// disjoint shards, by a hash of the file name or by subdirectory. Every shard is planned and applied
+// by its own worker process. Workers talk to the coordinator over their
+// standard input and output, one JSON message per line:
+//
+//   coordinator -> worker   plan     profile, directories and names of the files to work on
+//   worker -> coordinator   keys     sort key of every file the string add pattern applies to
+//   coordinator -> worker   number   global sequence number of each of these files
+//   worker -> coordinator   files    current and new path of every file, files to delete
+//   coordinator -> worker   stage    renames to skip, renames onto a name another rename vacates
+//   worker -> coordinator   staged
+//   coordinator -> worker   finish   sent once every shard has staged its renames
+//   worker -> coordinator   done     apply statistics
+//
+// The coordinator sends abort instead of stage if there is nothing to apply. A worker reports a
+// failure with an error message and exits.
+//
+// A worker that fails only loses its own shard, the other shards are still applied.
+class ShardCoordinator {
+public:
+    ShardCoordinator(const GlobalConfig& globalConfig, const Config& config, const json& profile);
+    ~ShardCoordinator();
+
+    void run();
+
+private:
+    struct Shard;
+
+    void createShards();
+    bool send(Shard& shard, const json& request);
+    bool receive(Shard& shard, const std::string& replyType, json& reply);
+    void fail(Shard& shard, const std::string& error);
+    void assignNumbers();
+    void checkCollisions();
+    bool confirmChanges();
+    void applyChanges();
+
+    const GlobalConfig& global;
+    const Config& config;
+    const json& profile;
+    std::filesystem::path targetDirectory;
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t renameCount = 0;
+    size_t deletionCount = 0;
+};
+
+// Runs a worker process, returns the process exit code.
+int runShardWorker();
@@ -0,0 +1,8 @@
+#pragma once
+
+// QUICKRENAME_SSE2 is defined where SSE2 intrinsics may be used: x64, 32-bit x86 built with
+// /arch:SSE2 or higher, and GCC or Clang targets with SSE2 enabled.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUICKRENAME_SSE2
+#include <emmintrin.h>
+#endif
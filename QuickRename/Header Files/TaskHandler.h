@@ -1,34 +1,85 @@
 #pragma once
 #include <Config.h>
 #include <File.h>
+#include <ApplyScheduler.h>
+#include <FileMetadata.h>
+#include <mutex>
+#include <regex>
 
 class TaskHandler {
 public:
     TaskHandler(const GlobalConfig& globalConfig, const Config& config);
 
+    TaskHandler(const GlobalConfig& globalConfig, const Config& config, const std::vector<std::filesystem::path>& directories, const std::vector<std::filesystem::path>& paths);
+
     void executeTasks();
 
+    // Shard worker steps, driven by the coordinator in ShardCoordinator.cpp
+    std::vector<std::string> planShard();
+    void numberShard(const std::vector<int>& numbers);
+    const std::vector<File>& getFiles() const;
+    const std::vector<File>& getFilesToDelete() const;
+    void stageShard(const std::vector<size_t>& skipped, const std::vector<size_t>& dependent);
+    void finishShard();
+    const ApplyScheduler::Result& getApplyStats() const;
+
 private:
+    using TaskFunction = std::function<void()>;
+
+    // A planned rename. 'temporary' is only used for renames onto a name that is being vacated.
+    struct RenameOperation {
+        std::filesystem::path source;
+        std::filesystem::path target;
+        std::filesystem::path temporary;
+    };
+
     void processFiles(const std::function<void(File&)>& action);
     std::vector<File> GetFileVector(const std::filesystem::path& directory = ".");
-    void deleteFile(const std::filesystem::path& filePath);
     std::string deleteSubString(const std::string& input, const std::string& target);
-    std::string generateNewName(const std::string& prefix, const std::string& suffix, const int& number_width, int& number, const int& step = 1);
+    std::regex::flag_type regexFlags() const;
+    std::string sortKey(const File& file, const std::regex& captureObj) const;
+    void sortFiles();
 
     void getTasks();
+    void getFileTasks(std::vector<TaskFunction>& fileTasks);
+    void processUnicodeNormalization();
     void processUnwantedExtensions();
+    void processDuplicates();
     void processStringDeleteList();
     void processStringReplacePattern();
     void processStringAddPattern();
+    std::vector<size_t> addPatternTargets(std::vector<FileMetadata>& metadata);
+    void renderAddPattern(const std::vector<size_t>& targets, const std::vector<FileMetadata>& metadata, const std::vector<int>& numbers);
+    void collectNameChangedFiles();
     void showChanges();
     void applyChanges();
+    void processOutOfCore();
+
+    std::vector<RenameOperation> stageRenames(const std::vector<RenameOperation>& renames, std::vector<RenameOperation> dependentRenames);
+    void runRenames(const std::vector<RenameOperation>& renames, std::vector<RenameOperation>* deferred);
+    std::vector<RenameOperation> moveToTemporaryNames(const std::vector<RenameOperation>& renames);
+    void moveFromTemporaryNames(const std::vector<RenameOperation>& renames);
+    bool restoreTemporaryNames();
+    void runDeletions(const std::vector<std::filesystem::path>& paths);
+    void addApplyStats(const ApplyScheduler::Result& result);
+    void showApplyStats();
 
     const GlobalConfig& global;
     const Config& config;
+    std::filesystem::path targetDirectory;
     std::vector<File> files;
     std::vector<File> nameChangedFiles;
     std::vector<File> filesToDelete;
 
-    using TaskFunction = std::function<void()>;
+    ApplyScheduler scheduler;
+    ApplyScheduler::Result applyStats;
+    std::mutex logMutex;
+    std::string temporarySuffix;
+
+    std::vector<std::filesystem::path> shardDirectories;
+    std::vector<size_t> shardTargets;
+    std::vector<FileMetadata> shardMetadata;
+    std::vector<RenameOperation> stagedRenames;
+
     std::vector<TaskFunction> tasks;
-};
\ No newline at end of file
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Helpers for UTF-8 file names. Every function checks for pure ASCII input first
+// and only decodes the string if it contains multi-byte sequences.
+
+// Returns true if no byte of 'text' has the high bit set, checked 16 bytes at a time.
+bool isAscii(std::string_view text);
+
+// Converts 'text' to Unicode Normalization Form C, so names written in decomposed form
+// (e.g. by macOS) match names typed in composed form. Returns 'text' unchanged if the
+// platform offers no normalization.
+std::string normalizeNfc(const std::string& text);
+
+// Returns false if normalizeNfc() can't normalize on this platform.
+bool isNormalizationSupported();
+
+// Returns true if 'a' and 'b' are equal ignoring case.
+bool equalsIgnoreCase(const std::string& a, const std::string& b);
+
+// Removes all occurrences of 'target' from 'text', optionally ignoring case.
+std::string eraseAll(const std::string& text, const std::string& target, bool ignoreCase);
+
+// Returns the byte offset of the code point with the given index, or std::string::npos
+// if 'text' has fewer code points.
+size_t codePointOffset(const std::string& text, size_t index);
@@ -0,0 +1,164 @@
+#include <ApplyScheduler.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+
+ApplyScheduler::ApplyScheduler(const Config::ApplyConcurrency& limits) : limits(limits), window(limits.min) {}
+
+bool ApplyScheduler::isTransientError(const std::error_code& ec) {
+    if (ec == std::errc::device_or_resource_busy || ec == std::errc::resource_unavailable_try_again ||
+        ec == std::errc::timed_out || ec == std::errc::interrupted) {
+        return true;
+    }
+
+#ifdef _WIN32
+    // Win32 codes reported for files held open by other processes and for flaky SMB servers
+    if (ec.category() == std::system_category()) {
+        switch (ec.value()) {
+        case ERROR_SHARING_VIOLATION:
+        case ERROR_LOCK_VIOLATION:
+        case ERROR_NETWORK_BUSY:
+        case ERROR_UNEXP_NET_ERR:
+        case ERROR_SEM_TIMEOUT:
+        case ERROR_NETNAME_DELETED:
+            return true;
+        }
+    }
+#endif
+
+    return false;
+}
+
+ApplyScheduler::Result ApplyScheduler::run(const std::vector<Operation>& operations) {
+    using Clock = std::chrono::steady_clock;
+
+    struct Retry {
+        size_t index;
+        int attempt;
+        Clock::time_point notBefore;
+    };
+
+    const auto latencyTarget = std::chrono::milliseconds(std::max(1, limits.latencyTargetMs));
+    const auto timeout = latencyTarget * 4;
+    const auto maxBackoff = std::chrono::milliseconds(5000);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    int inFlight = 0;
+    size_t next = 0;
+    size_t finished = 0;
+    std::vector<Retry> retries;
+    double totalLatencyMs = 0;
+    Result result;
+
+    // Halve the window, at most once per round trip so a burst of slow operations counts as one event
+    auto decrease = [&](Clock::time_point now, Clock::duration latency) {
+        if (now - lastDecrease > latency) {
+            window = std::max<double>(limits.min, window / 2);
+            lastDecrease = now;
+        }
+        };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (finished < operations.size()) {
+            Clock::time_point now = Clock::now();
+            size_t index = 0;
+            int attempt = 0;
+            bool found = false;
+
+            // Retries that waited long enough go first, then new operations
+            if (inFlight < static_cast<int>(window)) {
+                auto ready = std::find_if(retries.begin(), retries.end(), [&](const Retry& retry) { return retry.notBefore <= now; });
+                if (ready != retries.end()) {
+                    index = ready->index;
+                    attempt = ready->attempt;
+                    retries.erase(ready);
+                    found = true;
+                }
+                else if (next < operations.size()) {
+                    index = next++;
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                if (!retries.empty() && inFlight < static_cast<int>(window)) {
+                    auto earliest = std::min_element(retries.begin(), retries.end(), [](const Retry& a, const Retry& b) { return a.notBefore < b.notBefore; });
+                    wake.wait_until(lock, earliest->notBefore);
+                }
+                else {
+                    wake.wait(lock);
+                }
+                continue;
+            }
+
+            ++inFlight;
+            result.peakConcurrency = std::max(result.peakConcurrency, inFlight);
+            lock.unlock();
+
+            Clock::time_point start = Clock::now();
+            std::error_code ec = operations[index]();
+            Clock::time_point end = Clock::now();
+            Clock::duration latency = end - start;
+
+            lock.lock();
+            --inFlight;
+            totalLatencyMs += std::chrono::duration<double, std::milli>(latency).count();
+
+            if (!ec) {
+                ++result.succeeded;
+                ++finished;
+
+                // Additive increase of one operation per window, hold while latency is above target
+                if (latency > timeout) {
+                    decrease(end, latency);
+                }
+                else if (latency <= latencyTarget) {
+                    window = std::min<double>(limits.max, window + 1.0 / window);
+                }
+            }
+            else if (isTransientError(ec) && attempt < limits.retries) {
+                ++result.retried;
+                decrease(end, latency);
+                auto backoff = std::min<Clock::duration>(latencyTarget * (1LL << std::min(attempt, 16)), maxBackoff);
+                retries.push_back({ index, attempt + 1, end + backoff });
+            }
+            else {
+                ++result.failed;
+                ++finished;
+                result.failures.emplace_back(index, ec);
+                if (isTransientError(ec)) {
+                    decrease(end, latency);
+                }
+            }
+
+            wake.notify_all();
+        }
+        };
+
+    size_t threadCount = std::min(static_cast<size_t>(std::max(1, limits.max)), operations.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    size_t attempts = result.succeeded + result.failed + result.retried;
+    result.averageLatencyMs = attempts ? totalLatencyMs / attempts : 0;
+    return result;
+}
@@ -1,7 +1,9 @@
 #include <QuickRename.h>
+#include <Unicode.h>
 #include <iostream>
 #include <fstream>
 #include <regex>
+#include <thread>
 
 
 // Exits the program with a prompt to press Enter.
@@ -68,7 +70,9 @@ void ConfigFile::createConfigFile(const std::string& filename) {
         {"re_match", ""},
         {"format", ""},
         {"format_config", {{"start", 1}, {"step", 1}}},
-        {"position", 0}
+        {"position", 0},
+        {"sort", ""},
+        {"sort_re_match", ""}
     };
 
     // Constructing the JSON configuration
@@ -80,7 +84,10 @@ void ConfigFile::createConfigFile(const std::string& filename) {
 
     json profile;
     profile["target_dir"] = "";
+    profile["unicode_normalize"] = false;
+    profile["ignore_case"] = false;
     profile["unwanted_extension"] = json::array();
+    profile["delete_duplicates"] = "";
     profile["string_delete"] = json::array();
     profile["string_replace_pattern"] = json::array({ defaultStringReplacePattern });
     profile["string_add_pattern"] = defaultStringAddPattern;
@@ -107,6 +114,45 @@ Config::Config(const json& profile) {
         targetDir = ".";
     }
 
+    // Optional Unicode aware matching, both are off for profiles written before they existed
+    unicodeNormalize = profile.value("unicode_normalize", false);
+    ignoreCase = profile.value("ignore_case", false);
+    if (unicodeNormalize && !isNormalizationSupported()) {
+        std::cerr << "unicode_normalize is not supported on this platform, file names are not normalized." << std::endl;
+    }
+
+    // Optional adaptive apply, the default applies changes one at a time
+    if (profile.contains("apply_concurrency")) {
+        const auto& concurrency = profile["apply_concurrency"];
+        applyConcurrency.min = std::max(1, concurrency.value("min", 1));
+        applyConcurrency.max = std::max(applyConcurrency.min, concurrency.value("max", applyConcurrency.min));
+        applyConcurrency.latencyTargetMs = std::max(1, concurrency.value("latency_target_ms", 50));
+        applyConcurrency.retries = std::max(0, concurrency.value("retries", 3));
+    }
+
+    // Optional out-of-core planning for directories whose listing doesn't fit in memory
+    planMemoryBudget = static_cast<size_t>(std::max(0, profile.value("plan_memory_mb", 0))) * 1024 * 1024;
+    spillDir = profile.value("spill_dir", "");
+
+    // Optional coordinator mode, the profile is planned and applied by worker processes
+    if (profile.contains("shards")) {
+        const auto& shards = profile["shards"];
+        const std::string by = shards.value("by", "");
+
+        if (by == "name_hash") {
+            shardMode = ShardMode::NameHash;
+        }
+        else if (by == "subdirectory") {
+            shardMode = ShardMode::Subdirectory;
+        }
+        else if (!by.empty()) {
+            std::cerr << "Unknown shard mode: \"" << by << "\", the profile runs in a single process." << std::endl;
+        }
+
+        int defaultCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        shardCount = std::max(1, shards.value("count", defaultCount));
+    }
+
     unwantedExtensionList = profile["unwanted_extension"].get<std::vector<std::string>>();
 
     for (auto it = unwantedExtensionList.begin(); it != unwantedExtensionList.end(); ) {
@@ -120,6 +166,21 @@ Config::Config(const json& profile) {
         ++it;
     }
 
+    // Optional duplicate content deletion
+    if (profile.contains("delete_duplicates")) {
+        const std::string policy = profile["delete_duplicates"].get<std::string>();
+
+        if (policy == "keep_oldest") {
+            duplicatePolicy = DuplicatePolicy::KeepOldest;
+        }
+        else if (policy == "keep_shortest_name") {
+            duplicatePolicy = DuplicatePolicy::KeepShortestName;
+        }
+        else if (!policy.empty()) {
+            std::cerr << "Unknown delete_duplicates policy: \"" << policy << "\", duplicates are kept." << std::endl;
+        }
+    }
+
     stringDeleteList = profile["string_delete"].get<std::vector<std::string>>();
 
     for (const auto& entry : profile["string_replace_pattern"]) {
@@ -140,6 +201,54 @@ Config::Config(const json& profile) {
         stringAddPattern.formatConfig.start = strAddPattern["format_config"]["start"].get<int>();
         stringAddPattern.formatConfig.step = strAddPattern["format_config"]["step"].get<int>();
         stringAddPattern.position = strAddPattern["position"].get<int>();
+
+        // Optional numbering order, unknown values fall back to directory order
+        if (strAddPattern.contains("sort")) {
+            const std::string sort = strAddPattern["sort"].get<std::string>();
+
+            if (sort == "natural") {
+                stringAddPattern.sort = SortOrder::Natural;
+            }
+            else if (sort == "lexicographic") {
+                stringAddPattern.sort = SortOrder::Lexicographic;
+            }
+            else if (sort == "mtime") {
+                stringAddPattern.sort = SortOrder::MTime;
+            }
+            else if (sort == "size") {
+                stringAddPattern.sort = SortOrder::Size;
+            }
+            else if (sort == "re_capture") {
+                try {
+                    stringAddPattern.sortMatch = strAddPattern["sort_re_match"].get<std::string>();
+                    std::regex regexObj(stringAddPattern.sortMatch);
+                    stringAddPattern.sort = SortOrder::Capture;
+                }
+                catch (const std::regex_error& e) {
+                    std::cerr << "Error in regular expression: \"" + stringAddPattern.sortMatch + "\"\nDetail: " << e.what() << std::endl;
+                }
+            }
+            else if (!sort.empty()) {
+                std::cerr << "Unknown sort order: \"" << sort << "\", files are numbered in directory order." << std::endl;
+            }
+        }
+    }
+
+    // Bring configured strings into the same form as the normalized file names
+    if (unicodeNormalize) {
+        for (auto& extension : unwantedExtensionList) {
+            extension = normalizeNfc(extension);
+        }
+        for (auto& entry : stringDeleteList) {
+            entry = normalizeNfc(entry);
+        }
+        for (auto& [match, replace] : stringReplaceList) {
+            match = normalizeNfc(match);
+            replace = normalizeNfc(replace);
+        }
+        stringAddPattern.match = normalizeNfc(stringAddPattern.match);
+        stringAddPattern.format = normalizeNfc(stringAddPattern.format);
+        stringAddPattern.sortMatch = normalizeNfc(stringAddPattern.sortMatch);
     }
 }
 
@@ -163,10 +272,38 @@ const Config::StrAddPatternConfig& Config::getStringAddPattern() const {
     return stringAddPattern;
 }
 
+Config::DuplicatePolicy Config::getDuplicatePolicy() const {
+    return duplicatePolicy;
+}
+
+const Config::ApplyConcurrency& Config::getApplyConcurrency() const {
+    return applyConcurrency;
+}
+
+size_t Config::getPlanMemoryBudget() const {
+    return planMemoryBudget;
+}
+
+const std::string& Config::getSpillDir() const {
+    return spillDir;
+}
+
+Config::ShardMode Config::getShardMode() const {
+    return shardMode;
+}
+
+int Config::getShardCount() const {
+    return shardCount;
+}
+
 bool Config::isUnwantedExtensionListEmpty() const {
     return unwantedExtensionList.empty();
 }
 
+bool Config::isDeleteDuplicatesEmpty() const {
+    return duplicatePolicy == DuplicatePolicy::None;
+}
+
 bool Config::isStringDeleteListEmpty() const {
     return stringDeleteList.empty();
 }
@@ -179,6 +316,18 @@ bool Config::isStringAddPatternEmpty() const {
     return stringAddPattern.format.empty();
 }
 
+bool Config::isUnicodeNormalizeEnabled() const {
+    return unicodeNormalize;
+}
+
+bool Config::isIgnoreCaseEnabled() const {
+    return ignoreCase;
+}
+
+bool Config::isShardingEnabled() const {
+    return shardMode != ShardMode::None;
+}
+
 GlobalConfig::GlobalConfig(const json& globalConfig) {
     confirm = globalConfig["confirm"].get<bool>();
     exitWhenDone = globalConfig["exit_when_done"].get<bool>();
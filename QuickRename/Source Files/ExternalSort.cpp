@@ -0,0 +1,186 @@
+#include <ExternalSort.h>
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <queue>
+#include <stdexcept>
+
+
+namespace {
+    // Runs merged in one pass, keeps the number of open files well below the C runtime limit.
+    constexpr size_t maxOpenRuns = 64;
+
+    void writeString(std::ofstream& stream, const std::string& value) {
+        std::uint32_t length = static_cast<std::uint32_t>(value.size());
+        stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        stream.write(value.data(), value.size());
+    }
+
+    bool readString(std::ifstream& stream, std::string& value) {
+        std::uint32_t length = 0;
+        if (!stream.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            return false;
+        }
+        value.resize(length);
+        return static_cast<bool>(stream.read(value.data(), length));
+    }
+}
+
+
+bool SpillRecord::operator<(const SpillRecord& other) const {
+    int result = key.compare(other.key);
+    return result != 0 ? result < 0 : source < other.source;
+}
+
+RunWriter::RunWriter(const std::filesystem::path& path) : stream(path, std::ios::binary | std::ios::trunc) {
+    if (!stream.is_open()) {
+        throw std::runtime_error("Unable to create spill file " + path.string());
+    }
+}
+
+void RunWriter::write(const SpillRecord& record) {
+    writeString(stream, record.key);
+    writeString(stream, record.source);
+    writeString(stream, record.target);
+
+    if (!stream) {
+        throw std::runtime_error("Unable to write spill file, please check disk space.");
+    }
+}
+
+void RunWriter::close() {
+    stream.close();
+}
+
+RunReader::RunReader(const std::filesystem::path& path) : stream(path, std::ios::binary) {
+    if (!stream.is_open()) {
+        throw std::runtime_error("Unable to open spill file " + path.string());
+    }
+}
+
+bool RunReader::read(SpillRecord& record) {
+    return readString(stream, record.key) && readString(stream, record.source) && readString(stream, record.target);
+}
+
+ExternalSorter::ExternalSorter(const std::filesystem::path& directory, const std::string& prefix, size_t memoryBudget)
+    : directory(directory), prefix(prefix), memoryBudget(memoryBudget) {}
+
+// Removes the run files, the spill directory itself belongs to the caller.
+ExternalSorter::~ExternalSorter() {
+    std::error_code ec;
+    for (const auto& run : runs) {
+        std::filesystem::remove(run, ec);
+    }
+}
+
+std::filesystem::path ExternalSorter::nextRunPath() {
+    return directory / (prefix + "-" + std::to_string(runCount++) + ".run");
+}
+
+void ExternalSorter::add(SpillRecord record) {
+    bufferBytes += sizeof(SpillRecord) + record.key.capacity() + record.source.capacity() + record.target.capacity();
+    buffer.emplace_back(std::move(record));
+
+    if (bufferBytes >= memoryBudget) {
+        spill();
+    }
+}
+
+// Writes the buffered records as one sorted run and releases their memory.
+void ExternalSorter::spill() {
+    std::sort(std::execution::par, buffer.begin(), buffer.end());
+
+    std::filesystem::path path = nextRunPath();
+    RunWriter writer(path);
+    runs.push_back(path);
+    for (const auto& record : buffer) {
+        writer.write(record);
+    }
+    writer.close();
+
+    buffer.clear();
+    bufferBytes = 0;
+}
+
+// Merges 'inputs' into 'visit', or into a new run file if 'visit' is empty. Returns the new run.
+std::filesystem::path ExternalSorter::mergeRuns(const std::vector<std::filesystem::path>& inputs, const std::function<void(const SpillRecord&)>& visit) {
+    struct Head {
+        SpillRecord record;
+        size_t reader;
+    };
+    auto greater = [](const Head& a, const Head& b) { return b.record < a.record; };
+
+    std::vector<RunReader> readers;
+    readers.reserve(inputs.size());
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+
+    for (const auto& input : inputs) {
+        readers.emplace_back(input);
+        Head head{ {}, readers.size() - 1 };
+        if (readers.back().read(head.record)) {
+            heads.push(std::move(head));
+        }
+    }
+
+    std::filesystem::path output;
+    std::unique_ptr<RunWriter> writer;
+    if (!visit) {
+        output = nextRunPath();
+        writer = std::make_unique<RunWriter>(output);
+    }
+
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+
+        if (writer) {
+            writer->write(head.record);
+        }
+        else {
+            visit(head.record);
+        }
+
+        if (readers[head.reader].read(head.record)) {
+            heads.push(std::move(head));
+        }
+    }
+
+    return output;
+}
+
+void ExternalSorter::merge(const std::function<void(const SpillRecord&)>& visit) {
+    // Everything fit into memory, no need to touch the disk
+    if (runs.empty()) {
+        std::sort(std::execution::par, buffer.begin(), buffer.end());
+        for (const auto& record : buffer) {
+            visit(record);
+        }
+        return;
+    }
+
+    if (!buffer.empty()) {
+        spill();
+    }
+
+    // Reduce the number of runs until they can all be open at once
+    while (runs.size() > maxOpenRuns) {
+        std::vector<std::filesystem::path> merged;
+
+        for (size_t i = 0; i < runs.size(); i += maxOpenRuns) {
+            std::vector<std::filesystem::path> group(runs.begin() + i, runs.begin() + std::min(i + maxOpenRuns, runs.size()));
+            if (group.size() == 1) {
+                merged.push_back(group[0]);
+                continue;
+            }
+
+            merged.push_back(mergeRuns(group, nullptr));
+            for (const auto& run : group) {
+                std::filesystem::remove(run);
+            }
+        }
+
+        runs = std::move(merged);
+    }
+
+    mergeRuns(runs, visit);
+}
@@ -1,5 +1,17 @@
 #include <File.h>
-#include <iostream>
+#include <cerrno>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 
 void File::set_new_name(const std::string& new_n) {
@@ -42,28 +54,40 @@ bool File::is_name_changed() const {
     return !(name == new_name);
 }
 
-// Applies the new name to the file, renaming it in the file system.
-// Returns true if the operation is successful, false otherwise.
-bool File::applyNewName() {
-    try {
-        std::filesystem::path old_path = path;
-        std::filesystem::path new_path = File::get_new_name_path();
-
-        // Rename the file in the file system
-        std::filesystem::rename(old_path, new_path);
-
-        // Output the rename operation details
-        std::cout << "Rename: " << old_path << "  --->  " << new_path << std::endl;
-
-        // Update file attributes with the new name and path
-        name = new_name;
-        path = new_path;
+void renameNoReplace(const std::filesystem::path& from, const std::filesystem::path& to, std::error_code& ec) {
+    ec.clear();
 
-        return true;
+#ifdef _WIN32
+    // Without MOVEFILE_REPLACE_EXISTING an existing target fails with ERROR_ALREADY_EXISTS
+    if (!MoveFileExW(from.c_str(), to.c_str(), 0)) {
+        ec.assign(static_cast<int>(GetLastError()), std::system_category());
+    }
+#else
+#if defined(RENAME_NOREPLACE)
+    if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+        return;
+    }
+    if (errno != EINVAL && errno != ENOSYS && errno != ENOTSUP) {
+        ec.assign(errno, std::generic_category());
+        return;
+    }
+#endif
+    // File systems without an atomic no-replace rename (CIFS/SMB, some NFS): check the target first.
+    // Renames of one plan never share a target, so only files created outside QuickRename can race here.
+    // A target that is the source itself, e.g. a case-only rename on a case-insensitive mount, is no collision.
+    struct stat source, target;
+    if (lstat(to.c_str(), &target) == 0) {
+        if (lstat(from.c_str(), &source) != 0 || source.st_dev != target.st_dev || source.st_ino != target.st_ino) {
+            ec = std::make_error_code(std::errc::file_exists);
+            return;
+        }
+    }
+    else if (errno != ENOENT) {
+        ec.assign(errno, std::generic_category());
+        return;
     }
-    catch (const std::filesystem::filesystem_error& e) {
-        // Handle and log any errors that occur during the rename operation
-        std::cerr << e.what() << std::endl;
-        return false;
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        ec.assign(errno, std::generic_category());
     }
+#endif
 }
@@ -0,0 +1,381 @@
+#include <FileHash.h>
+#include <Simd.h>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+
+namespace {
+    constexpr std::uint64_t prime1 = 11400714785074694791ULL;
+    constexpr std::uint64_t prime2 = 14029467366897019727ULL;
+    constexpr std::uint64_t prime3 = 1609587929392839161ULL;
+    constexpr std::uint64_t prime4 = 9650029242287828579ULL;
+    constexpr std::uint64_t prime5 = 2870177450012600261ULL;
+
+    // Size of the buffer used for sequential reads of whole files.
+    constexpr size_t readBufferSize = 1 << 20;
+
+    std::uint64_t read64(const unsigned char* p) {
+        std::uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    std::uint64_t mixRound(std::uint64_t acc, std::uint64_t input) {
+        acc += input * prime2;
+        acc = std::rotl(acc, 31);
+        return acc * prime1;
+    }
+
+    std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t value) {
+        acc ^= mixRound(0, value);
+        return acc * prime1 + prime4;
+    }
+
+    // XXH3 parameters, the secret is the default one of the reference implementation
+    constexpr size_t stripeLength = 64;
+    constexpr size_t stripesPerBlock = 16;
+    constexpr std::uint64_t prime32_1 = 0x9E3779B1U;
+    constexpr std::uint64_t prime32_2 = 0x85EBCA77U;
+    constexpr std::uint64_t prime32_3 = 0xC2B2AE3DU;
+
+    alignas(64) constexpr unsigned char secret[192] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+    };
+
+    // Adds 'count' stripes to the accumulators using the keys starting at 'key'. Each lane gets
+    // its neighbour's input and a keyed 32x32 bit product. The lanes stay in registers meanwhile.
+    void accumulateStripes(std::uint64_t* acc, const unsigned char* data, const unsigned char* key, size_t count) {
+#ifdef QUICKRENAME_SSE2
+        __m128i lanes[4];
+        for (size_t i = 0; i < 4; ++i) {
+            lanes[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(acc) + i);
+        }
+
+        for (size_t stripe = 0; stripe < count; ++stripe, data += stripeLength, key += 8) {
+            for (size_t i = 0; i < 4; ++i) {
+                __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + i);
+                __m128i keyed = _mm_xor_si128(value, _mm_loadu_si128(reinterpret_cast<const __m128i*>(key) + i));
+                __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+                __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+                lanes[i] = _mm_add_epi64(product, _mm_add_epi64(lanes[i], swapped));
+            }
+        }
+
+        for (size_t i = 0; i < 4; ++i) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(acc) + i, lanes[i]);
+        }
+#else
+        std::uint64_t lanes[8];
+        std::memcpy(lanes, acc, sizeof(lanes));
+
+        for (size_t stripe = 0; stripe < count; ++stripe, data += stripeLength, key += 8) {
+            for (size_t i = 0; i < 8; ++i) {
+                std::uint64_t value = read64(data + i * 8);
+                std::uint64_t keyed = value ^ read64(key + i * 8);
+                lanes[i ^ 1] += value;
+                lanes[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+            }
+        }
+
+        std::memcpy(acc, lanes, sizeof(lanes));
+#endif
+    }
+
+    // Consumes 'count' stripes, scrambling the accumulators at the end of every block
+    void consumeStripes(std::uint64_t* acc, size_t& stripesInBlock, const unsigned char* data, size_t count) {
+        while (count > 0) {
+            size_t stripes = std::min(count, stripesPerBlock - stripesInBlock);
+            accumulateStripes(acc, data, secret + stripesInBlock * 8, stripes);
+            data += stripes * stripeLength;
+            count -= stripes;
+            stripesInBlock += stripes;
+
+            if (stripesInBlock == stripesPerBlock) {
+                for (size_t lane = 0; lane < 8; ++lane) {
+                    std::uint64_t value = acc[lane];
+                    value ^= value >> 47;
+                    value ^= read64(secret + sizeof(secret) - stripeLength + lane * 8);
+                    acc[lane] = value * prime32_1;
+                }
+                stripesInBlock = 0;
+            }
+        }
+    }
+
+    // Folds the 128 bit product of 'a' and 'b' into 64 bits
+    std::uint64_t multiplyFold(std::uint64_t a, std::uint64_t b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned __int64 high;
+        unsigned __int64 low = _umul128(a, b, &high);
+        return low ^ high;
+#elif defined(__SIZEOF_INT128__)
+        unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#else
+        std::uint64_t lowLow = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+        std::uint64_t highLow = (a >> 32) * (b & 0xFFFFFFFF);
+        std::uint64_t lowHigh = (a & 0xFFFFFFFF) * (b >> 32);
+        std::uint64_t highHigh = (a >> 32) * (b >> 32);
+        std::uint64_t cross = (lowLow >> 32) + (highLow & 0xFFFFFFFF) + lowHigh;
+        std::uint64_t high = (highLow >> 32) + (cross >> 32) + highHigh;
+        std::uint64_t low = (cross << 32) | (lowLow & 0xFFFFFFFF);
+        return low ^ high;
+#endif
+    }
+}
+
+
+ContentHash::ContentHash(std::uint64_t seed) : buffer{}, bufferSize(0), totalLength(0) {
+    lanes[0] = seed + prime1 + prime2;
+    lanes[1] = seed + prime2;
+    lanes[2] = seed;
+    lanes[3] = seed - prime1;
+}
+
+void ContentHash::update(const unsigned char* data, size_t length) {
+    totalLength += length;
+
+    // Complete a stripe left over from the previous call
+    if (bufferSize > 0) {
+        size_t fill = std::min(sizeof(buffer) - bufferSize, length);
+        std::memcpy(buffer + bufferSize, data, fill);
+        bufferSize += fill;
+        data += fill;
+        length -= fill;
+
+        if (bufferSize < sizeof(buffer)) {
+            return;
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            lanes[lane] = mixRound(lanes[lane], read64(buffer + lane * 8));
+        }
+        bufferSize = 0;
+    }
+
+    // Main loop, the four lanes have no dependency on each other
+    std::uint64_t v0 = lanes[0], v1 = lanes[1], v2 = lanes[2], v3 = lanes[3];
+    while (length >= 32) {
+        v0 = mixRound(v0, read64(data));
+        v1 = mixRound(v1, read64(data + 8));
+        v2 = mixRound(v2, read64(data + 16));
+        v3 = mixRound(v3, read64(data + 24));
+        data += 32;
+        length -= 32;
+    }
+    lanes[0] = v0; lanes[1] = v1; lanes[2] = v2; lanes[3] = v3;
+
+    std::memcpy(buffer, data, length);
+    bufferSize = length;
+}
+
+std::uint64_t ContentHash::digest() const {
+    std::uint64_t hash;
+
+    if (totalLength >= 32) {
+        hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+        for (std::uint64_t lane : lanes) {
+            hash = mergeRound(hash, lane);
+        }
+    }
+    else {
+        hash = lanes[2] + prime5;
+    }
+    hash += totalLength;
+
+    // Fold the tail that didn't fill a stripe
+    const unsigned char* p = buffer;
+    size_t remaining = bufferSize;
+    for (; remaining >= 8; p += 8, remaining -= 8) {
+        hash ^= mixRound(0, read64(p));
+        hash = std::rotl(hash, 27) * prime1 + prime4;
+    }
+    if (remaining >= 4) {
+        hash ^= read32(p) * prime1;
+        hash = std::rotl(hash, 23) * prime2 + prime3;
+        p += 4;
+        remaining -= 4;
+    }
+    for (; remaining > 0; ++p, --remaining) {
+        hash ^= *p * prime5;
+        hash = std::rotl(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+WideContentHash::WideContentHash() : accumulators{ prime32_3, prime1, prime2, prime3, prime4, prime32_2, prime5, prime32_1 },
+    buffer{}, lastStripe{}, bufferSize(0), stripesInBlock(0), totalLength(0) {}
+
+void WideContentHash::update(const unsigned char* data, size_t length) {
+    totalLength += length;
+
+    // Stripes are only consumed once more input follows them, the final stripe is left to digest()
+    if (bufferSize + length <= sizeof(buffer)) {
+        std::memcpy(buffer + bufferSize, data, length);
+        bufferSize += length;
+        return;
+    }
+
+    if (bufferSize > 0) {
+        size_t fill = sizeof(buffer) - bufferSize;
+        std::memcpy(buffer + bufferSize, data, fill);
+        data += fill;
+        length -= fill;
+        consumeStripes(accumulators, stripesInBlock, buffer, sizeof(buffer) / stripeLength);
+        std::memcpy(lastStripe, buffer + sizeof(buffer) - stripeLength, stripeLength);
+        bufferSize = 0;
+    }
+
+    // Consume large inputs in place, keeping at least one byte back
+    if (length > sizeof(buffer)) {
+        size_t stripes = (length - 1) / stripeLength;
+        consumeStripes(accumulators, stripesInBlock, data, stripes);
+        std::memcpy(lastStripe, data + stripes * stripeLength - stripeLength, stripeLength);
+        data += stripes * stripeLength;
+        length -= stripes * stripeLength;
+    }
+
+    std::memcpy(buffer, data, length);
+    bufferSize = length;
+}
+
+std::uint64_t WideContentHash::digest() const {
+    // Nothing was consumed yet, all input is still buffered
+    if (totalLength <= 240) {
+        ContentHash hash;
+        hash.update(buffer, bufferSize);
+        return hash.digest();
+    }
+
+    alignas(16) std::uint64_t acc[8];
+    std::memcpy(acc, accumulators, sizeof(acc));
+    size_t stripes = stripesInBlock;
+
+    // The last stripe always ends at the last byte, it may overlap stripes consumed before
+    unsigned char joined[stripeLength];
+    const unsigned char* last = joined;
+    if (bufferSize >= stripeLength) {
+        consumeStripes(acc, stripes, buffer, (bufferSize - 1) / stripeLength);
+        last = buffer + bufferSize - stripeLength;
+    }
+    else {
+        std::memcpy(joined, lastStripe + bufferSize, stripeLength - bufferSize);
+        std::memcpy(joined + stripeLength - bufferSize, buffer, bufferSize);
+    }
+    accumulateStripes(acc, last, secret + sizeof(secret) - stripeLength - 7, 1);
+
+    std::uint64_t hash = totalLength * prime1;
+    for (size_t i = 0; i < 4; ++i) {
+        hash += multiplyFold(acc[2 * i] ^ read64(secret + 11 + 16 * i), acc[2 * i + 1] ^ read64(secret + 11 + 16 * i + 8));
+    }
+
+    hash ^= hash >> 37;
+    hash *= 0x165667919E3779F9ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::uint64_t hashFileBlocks(const std::filesystem::path& path, std::uint64_t size, std::error_code& ec) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return 0;
+    }
+
+    ContentHash hash(size);
+    unsigned char block[partialHashBlockSize];
+
+    // Small files are covered completely by the head and tail blocks
+    std::uint64_t headSize = std::min(size, partialHashBlockSize * 2);
+    std::vector<unsigned char> head(static_cast<size_t>(headSize));
+    if (!file.read(reinterpret_cast<char*>(head.data()), headSize)) {
+        ec = std::make_error_code(std::errc::io_error);
+        return 0;
+    }
+    hash.update(head.data(), head.size());
+
+    if (size > headSize) {
+        file.seekg(static_cast<std::streamoff>(size - partialHashBlockSize));
+        if (!file.read(reinterpret_cast<char*>(block), partialHashBlockSize)) {
+            ec = std::make_error_code(std::errc::io_error);
+            return 0;
+        }
+        hash.update(block, partialHashBlockSize);
+    }
+
+    return hash.digest();
+}
+
+std::uint64_t hashFile(const std::filesystem::path& path, std::error_code& ec) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return 0;
+    }
+
+    WideContentHash hash;
+    std::vector<unsigned char> buffer(readBufferSize);
+
+    while (file) {
+        file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        hash.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+
+    if (file.bad()) {
+        ec = std::make_error_code(std::errc::io_error);
+        return 0;
+    }
+
+    return hash.digest();
+}
+
+bool isSameContent(const std::filesystem::path& first, const std::filesystem::path& second) {
+    std::ifstream a(first, std::ios::binary);
+    std::ifstream b(second, std::ios::binary);
+    if (!a.is_open() || !b.is_open()) {
+        return false;
+    }
+
+    std::vector<char> bufferA(readBufferSize);
+    std::vector<char> bufferB(readBufferSize);
+
+    while (a && b) {
+        a.read(bufferA.data(), bufferA.size());
+        b.read(bufferB.data(), bufferB.size());
+
+        if (a.gcount() != b.gcount() || std::memcmp(bufferA.data(), bufferB.data(), static_cast<size_t>(a.gcount())) != 0) {
+            return false;
+        }
+    }
+
+    return !a.bad() && !b.bad() && a.eof() && b.eof();
+}
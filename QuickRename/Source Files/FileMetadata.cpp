@@ -0,0 +1,111 @@
+#include <FileMetadata.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+
+#ifdef _WIN32
+
+namespace {
+    // FILETIME counts 100ns intervals since 1601-01-01.
+    constexpr std::int64_t fileTimeUnixEpoch = 116444736000000000LL;
+
+    std::int64_t toUnixNanoseconds(const FILETIME& time) {
+        std::int64_t ticks = (static_cast<std::int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+        return (ticks - fileTimeUnixEpoch) * 100;
+    }
+}
+
+bool queryFileMetadata(const std::filesystem::path& path, unsigned fields, FileMetadata& metadata) {
+    if (fields == MetadataNone) {
+        return true;
+    }
+
+    // The file index needs an open handle, which also gives us everything else in one call
+    if (fields & MetadataInode) {
+        HANDLE handle = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        BY_HANDLE_FILE_INFORMATION info;
+        BOOL ok = GetFileInformationByHandle(handle, &info);
+        CloseHandle(handle);
+        if (!ok) {
+            return false;
+        }
+
+        metadata.size = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        metadata.mtime = toUnixNanoseconds(info.ftLastWriteTime);
+        metadata.ctime = toUnixNanoseconds(info.ftCreationTime);
+        metadata.inode = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        return true;
+    }
+
+    // Size and times come from the directory entry without opening the file
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+
+    metadata.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    metadata.mtime = toUnixNanoseconds(data.ftLastWriteTime);
+    metadata.ctime = toUnixNanoseconds(data.ftCreationTime);
+    return true;
+}
+
+#elif defined(STATX_BASIC_STATS)
+
+bool queryFileMetadata(const std::filesystem::path& path, unsigned fields, FileMetadata& metadata) {
+    if (fields == MetadataNone) {
+        return true;
+    }
+
+    // Ask only for what the caller needs, network filesystems may skip the rest
+    unsigned mask = 0;
+    if (fields & MetadataSize) mask |= STATX_SIZE;
+    if (fields & MetadataMTime) mask |= STATX_MTIME;
+    if (fields & MetadataCTime) mask |= STATX_CTIME;
+    if (fields & MetadataInode) mask |= STATX_INO;
+
+    struct statx info;
+    if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, mask, &info) != 0) {
+        return false;
+    }
+
+    metadata.size = info.stx_size;
+    metadata.mtime = info.stx_mtime.tv_sec * 1000000000LL + info.stx_mtime.tv_nsec;
+    metadata.ctime = info.stx_ctime.tv_sec * 1000000000LL + info.stx_ctime.tv_nsec;
+    metadata.inode = info.stx_ino;
+    return true;
+}
+
+#else
+
+bool queryFileMetadata(const std::filesystem::path& path, unsigned fields, FileMetadata& metadata) {
+    if (fields == MetadataNone) {
+        return true;
+    }
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+
+    metadata.size = static_cast<std::uint64_t>(info.st_size);
+    metadata.mtime = static_cast<std::int64_t>(info.st_mtime) * 1000000000LL;
+    metadata.ctime = static_cast<std::int64_t>(info.st_ctime) * 1000000000LL;
+    metadata.inode = static_cast<std::uint64_t>(info.st_ino);
+    return true;
+}
+
+#endif
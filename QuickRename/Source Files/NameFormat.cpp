@@ -0,0 +1,152 @@
+#include <NameFormat.h>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+
+
+namespace {
+    const std::string defaultDateFormat = "%Y-%m-%d";
+
+    // Formats nanoseconds since the Unix epoch as a local date using strftime syntax.
+    std::string formatDate(std::int64_t nanoseconds, const std::string& format) {
+        std::time_t seconds = static_cast<std::time_t>(nanoseconds / 1000000000LL);
+        if (nanoseconds < 0 && nanoseconds % 1000000000LL != 0) {
+            --seconds;
+        }
+
+        std::tm local{};
+#ifdef _WIN32
+        if (localtime_s(&local, &seconds) != 0) {
+            return {};
+        }
+#else
+        if (localtime_r(&seconds, &local) == nullptr) {
+            return {};
+        }
+#endif
+
+        char buffer[128];
+        size_t length = std::strftime(buffer, sizeof(buffer), format.c_str(), &local);
+        return std::string(buffer, length);
+    }
+
+    // Splits "mtime:%Y%m%d" into the token name and its argument.
+    bool matchToken(const std::string& token, const std::string& name, std::string& argument) {
+        if (token == name) {
+            argument.clear();
+            return true;
+        }
+        if (token.size() > name.size() + 1 && token.compare(0, name.size(), name) == 0 && token[name.size()] == ':') {
+            argument = token.substr(name.size() + 1);
+            return true;
+        }
+        return false;
+    }
+}
+
+
+// Parses the format once, so rendering a name doesn't touch the regex engine.
+NameFormat::NameFormat(const std::string& format) {
+    std::string literal;
+    size_t pos = 0;
+
+    while (pos < format.size()) {
+        if (format[pos] != '\\') {
+            literal += format[pos++];
+            continue;
+        }
+
+        size_t close = format.find('\\', pos + 1);
+        if (close == std::string::npos) {
+            literal.append(format, pos);
+            break;
+        }
+
+        std::string token = format.substr(pos + 1, close - pos - 1);
+        std::string argument;
+        Segment segment;
+
+        if (!token.empty() && token.size() <= 9 && token.find_first_not_of("0123456789") == std::string::npos) {
+            segment = { SegmentType::Counter, {}, std::stoi(token) };
+            counter = true;
+        }
+        else if (matchToken(token, "mtime", argument)) {
+            segment = { SegmentType::MTime, argument.empty() ? defaultDateFormat : argument };
+            requiredFields |= MetadataMTime;
+        }
+        else if (matchToken(token, "ctime", argument)) {
+            segment = { SegmentType::CTime, argument.empty() ? defaultDateFormat : argument };
+            requiredFields |= MetadataCTime;
+        }
+        else if (token == "size") {
+            segment = { SegmentType::Size, {} };
+            requiredFields |= MetadataSize;
+        }
+        else if (token == "parent") {
+            segment = { SegmentType::Parent, {} };
+        }
+        else if (token == "inode") {
+            segment = { SegmentType::Inode, {} };
+            requiredFields |= MetadataInode;
+        }
+        else {
+            // Not a token, keep the backslash and let the closing one start the next token
+            literal += format[pos++];
+            continue;
+        }
+
+        addLiteral(literal);
+        literal.clear();
+        segments.push_back(std::move(segment));
+        pos = close + 1;
+    }
+
+    addLiteral(literal);
+}
+
+void NameFormat::addLiteral(const std::string& text) {
+    if (!text.empty()) {
+        segments.push_back({ SegmentType::Literal, text });
+    }
+}
+
+unsigned NameFormat::getRequiredFields() const {
+    return requiredFields;
+}
+
+bool NameFormat::hasCounter() const {
+    return counter;
+}
+
+// Builds the string to add for a file. 'metadata' only needs the fields from getRequiredFields().
+std::string NameFormat::render(const File& file, const FileMetadata& metadata, int number) const {
+    std::ostringstream result;
+
+    for (const Segment& segment : segments) {
+        switch (segment.type) {
+        case SegmentType::Literal:
+            result << segment.text;
+            break;
+        case SegmentType::Counter:
+            result << std::setw(segment.width) << std::setfill('0') << number;
+            break;
+        case SegmentType::MTime:
+            result << formatDate(metadata.mtime, segment.text);
+            break;
+        case SegmentType::CTime:
+            result << formatDate(metadata.ctime, segment.text);
+            break;
+        case SegmentType::Size:
+            result << metadata.size;
+            break;
+        case SegmentType::Parent:
+            result << file.get_path().parent_path().filename().string();
+            break;
+        case SegmentType::Inode:
+            result << metadata.inode;
+            break;
+        }
+    }
+
+    return result.str();
+}
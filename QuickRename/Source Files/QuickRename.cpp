@@ -11,6 +11,11 @@ int main(int argc, char* argv[]) {
         size_t lastSlash = fullPath.find_last_of("/\\");
         self_file_name = (lastSlash != std::string::npos) ? fullPath.substr(lastSlash + 1) : fullPath;
     }
+
+    // Started by a coordinator, the profile arrives over standard input
+    if (argc > 1 && argv[1] == shardWorkerArgument) {
+        return runShardWorker();
+    }
     
     ConfigFile configFile;
     GlobalConfig global(configFile.getGlobalConfig());
@@ -20,6 +25,11 @@ int main(int argc, char* argv[]) {
 
     for (const auto& profile : profiles) {
         Config config(profile);
+        if (config.isShardingEnabled()) {
+            ShardCoordinator coordinator(global, config, profile);
+            coordinator.run();
+            continue;
+        }
         TaskHandler task_handler(global, config);
         task_handler.executeTasks();
     }
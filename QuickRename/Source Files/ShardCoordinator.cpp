@@ -0,0 +1,845 @@
+#include <QuickRename.h>
+#include <ShardCoordinator.h>
+#include <FileHash.h>
+#include <iostream>
+#include <format>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+
+namespace {
+    // Paths travel as UTF-8 so names survive regardless of the code page of either process
+    std::string toUtf8(const std::filesystem::path& path) {
+        const std::u8string text = path.u8string();
+        return std::string(text.begin(), text.end());
+    }
+
+    std::filesystem::path fromUtf8(const std::string& text) {
+        return std::filesystem::path(std::u8string(text.begin(), text.end()));
+    }
+
+    // Sort keys are binary, hex keeps them valid JSON strings and compares in the same order
+    std::string toHex(const std::string& bytes) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(bytes.size() * 2);
+        for (unsigned char c : bytes) {
+            hex += digits[c >> 4];
+            hex += digits[c & 0x0F];
+        }
+        return hex;
+    }
+
+    // Returns the shard a file name belongs to
+    size_t shardOfName(const std::string& name, size_t shardCount) {
+        ContentHash hash;
+        hash.update(reinterpret_cast<const unsigned char*>(name.data()), name.size());
+        return static_cast<size_t>(hash.digest() % shardCount);
+    }
+
+    std::string dumpMessage(const json& message) {
+        return message.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+    }
+
+    void confirmWithMsg(const std::string& message) {
+        std::cout << "\n" << message;
+        std::cin.get();
+    }
+
+    std::filesystem::path executablePath() {
+#ifdef _WIN32
+        std::wstring buffer(MAX_PATH, L'\0');
+        DWORD length;
+        while ((length = GetModuleFileNameW(nullptr, buffer.data(), static_cast<DWORD>(buffer.size()))) == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        buffer.resize(length);
+        return buffer;
+#else
+        std::error_code ec;
+        std::filesystem::path path = std::filesystem::read_symlink("/proc/self/exe", ec);
+        return ec ? std::filesystem::path() : path;
+#endif
+    }
+
+    // A worker process connected to the coordinator through pipes on its standard input and output.
+    // Standard error is shared with the coordinator, so worker messages show up on the same console.
+    class WorkerProcess {
+    private:
+#ifdef _WIN32
+        HANDLE process = nullptr;
+        HANDLE input = nullptr;
+        HANDLE output = nullptr;
+#else
+        pid_t process = -1;
+        int input = -1;
+        int output = -1;
+#endif
+        std::string buffer;
+        size_t scanned = 0;
+
+        bool writeAll(const std::string& data);
+        long long readSome(char* data, size_t size);
+
+    public:
+        WorkerProcess() = default;
+        ~WorkerProcess();
+
+        WorkerProcess(const WorkerProcess&) = delete;
+        WorkerProcess& operator=(const WorkerProcess&) = delete;
+
+        bool start(const std::filesystem::path& executable);
+        bool send(const json& message);
+        // Returns false if the worker closed its output.
+        bool receive(json& message);
+        // Closes the pipes and waits for the worker to exit.
+        void stop();
+    };
+
+#ifdef _WIN32
+    bool WorkerProcess::start(const std::filesystem::path& executable) {
+        SECURITY_ATTRIBUTES security{ sizeof(security), nullptr, TRUE };
+        HANDLE childInput = nullptr;
+        HANDLE childOutput = nullptr;
+
+        // Only the child's ends of the pipes are inherited
+        if (!CreatePipe(&childInput, &input, &security, 0)) {
+            return false;
+        }
+        SetHandleInformation(input, HANDLE_FLAG_INHERIT, 0);
+        if (!CreatePipe(&output, &childOutput, &security, 0)) {
+            CloseHandle(childInput);
+            return false;
+        }
+        SetHandleInformation(output, HANDLE_FLAG_INHERIT, 0);
+
+        STARTUPINFOW startup{};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdInput = childInput;
+        startup.hStdOutput = childOutput;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+        std::wstring commandLine = L"\"" + executable.wstring() + L"\" " + std::filesystem::path(shardWorkerArgument).wstring();
+        PROCESS_INFORMATION info{};
+        BOOL created = CreateProcessW(executable.c_str(), commandLine.data(), nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startup, &info);
+
+        CloseHandle(childInput);
+        CloseHandle(childOutput);
+        if (!created) {
+            return false;
+        }
+
+        CloseHandle(info.hThread);
+        process = info.hProcess;
+        return true;
+    }
+
+    bool WorkerProcess::writeAll(const std::string& data) {
+        for (size_t offset = 0; offset < data.size();) {
+            DWORD written = 0;
+            DWORD size = static_cast<DWORD>(std::min<size_t>(data.size() - offset, 1 << 20));
+            if (!WriteFile(input, data.data() + offset, size, &written, nullptr)) {
+                return false;
+            }
+            offset += written;
+        }
+        return true;
+    }
+
+    long long WorkerProcess::readSome(char* data, size_t size) {
+        DWORD read = 0;
+        if (!ReadFile(output, data, static_cast<DWORD>(size), &read, nullptr)) {
+            return -1;
+        }
+        return read;
+    }
+
+    void WorkerProcess::stop() {
+        if (input) {
+            CloseHandle(input);
+            input = nullptr;
+        }
+        if (output) {
+            CloseHandle(output);
+            output = nullptr;
+        }
+        if (process) {
+            WaitForSingleObject(process, INFINITE);
+            CloseHandle(process);
+            process = nullptr;
+        }
+    }
+#else
+    bool WorkerProcess::start(const std::filesystem::path& executable) {
+        int toChild[2];
+        int fromChild[2];
+        if (pipe(toChild) != 0) {
+            return false;
+        }
+        if (pipe(fromChild) != 0) {
+            close(toChild[0]);
+            close(toChild[1]);
+            return false;
+        }
+
+        process = fork();
+        if (process == 0) {
+            dup2(toChild[0], STDIN_FILENO);
+            dup2(fromChild[1], STDOUT_FILENO);
+            close(toChild[0]);
+            close(toChild[1]);
+            close(fromChild[0]);
+            close(fromChild[1]);
+            execl(executable.c_str(), executable.c_str(), shardWorkerArgument.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        close(toChild[0]);
+        close(fromChild[1]);
+        input = toChild[1];
+        output = fromChild[0];
+
+        // Workers started later must not inherit the coordinator's ends of these pipes
+        fcntl(input, F_SETFD, FD_CLOEXEC);
+        fcntl(output, F_SETFD, FD_CLOEXEC);
+        return process > 0;
+    }
+
+    bool WorkerProcess::writeAll(const std::string& data) {
+        for (size_t offset = 0; offset < data.size();) {
+            ssize_t written = write(input, data.data() + offset, data.size() - offset);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    long long WorkerProcess::readSome(char* data, size_t size) {
+        ssize_t count;
+        do {
+            count = read(output, data, size);
+        } while (count < 0 && errno == EINTR);
+        return count;
+    }
+
+    void WorkerProcess::stop() {
+        if (input >= 0) {
+            close(input);
+            input = -1;
+        }
+        if (output >= 0) {
+            close(output);
+            output = -1;
+        }
+        if (process > 0) {
+            int status = 0;
+            waitpid(process, &status, 0);
+            process = -1;
+        }
+    }
+#endif
+
+    WorkerProcess::~WorkerProcess() {
+        stop();
+    }
+
+    bool WorkerProcess::send(const json& message) {
+        return writeAll(dumpMessage(message));
+    }
+
+    bool WorkerProcess::receive(json& message) {
+        size_t newline;
+        while ((newline = buffer.find('\n', scanned)) == std::string::npos) {
+            scanned = buffer.size();
+            char chunk[65536];
+            long long count = readSome(chunk, sizeof(chunk));
+            if (count <= 0) {
+                return false;
+            }
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+
+        message = json::parse(buffer.begin(), buffer.begin() + newline);
+        buffer.erase(0, newline + 1);
+        scanned = 0;
+        return true;
+    }
+}
+
+
+struct ShardCoordinator::Shard {
+    size_t index = 0;
+    std::vector<std::filesystem::path> directories;
+    // Names of the shard's files in each of 'directories', as UTF-8
+    std::vector<std::vector<std::string>> names;
+    WorkerProcess worker;
+    bool failed = false;
+
+    std::vector<std::string> keys;
+    std::vector<int> numbers;
+    std::vector<std::pair<std::string, std::string>> files;
+    std::vector<std::string> deletions;
+    std::vector<size_t> skipped;
+    std::vector<size_t> dependent;
+    json stats;
+};
+
+ShardCoordinator::ShardCoordinator(const GlobalConfig& globalConfig, const Config& config, const json& profile)
+    : global(globalConfig), config(config), profile(profile) {
+    targetDirectory = std::filesystem::absolute(config.getTargetDir()).lexically_normal();
+    if (!targetDirectory.has_filename()) {
+        targetDirectory = targetDirectory.parent_path();
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() = default;
+
+// Lists the target once and splits its files into shards. Both modes cover the same files, those of
+// the target directory and of all its subdirectories. By name hash, every shard gets every directory
+// and the files whose name hashes to its index. By subdirectory, the directories are handed out in
+// contiguous blocks, so numbering can go block by block.
+void ShardCoordinator::createShards() {
+    // Directories in path order, so the files directly in the target directory come first.
+    // Symlinked directories are not followed, so no file is listed twice.
+    std::map<std::filesystem::path, std::vector<std::string>> tree;
+    tree[targetDirectory];
+    const std::filesystem::path currentDirectory = std::filesystem::current_path();
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(targetDirectory, std::filesystem::directory_options::skip_permission_denied)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+
+        // Skip config.json and QuickRename itself in the current directory
+        std::string name = toUtf8(entry.path().filename());
+        std::error_code ec;
+        if ((name == "config.json" || name == self_file_name) && std::filesystem::equivalent(entry.path().parent_path(), currentDirectory, ec)) {
+            continue;
+        }
+        tree[entry.path().parent_path()].push_back(std::move(name));
+    }
+
+    size_t count = static_cast<size_t>(config.getShardCount());
+    const bool byName = config.getShardMode() == Config::ShardMode::NameHash;
+    if (!byName) {
+        count = std::min(count, tree.size());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->index = i;
+    }
+
+    size_t directoryIndex = 0;
+    for (auto& [directory, names] : tree) {
+        if (byName) {
+            for (const auto& shard : shards) {
+                shard->directories.push_back(directory);
+                shard->names.emplace_back();
+            }
+            for (std::string& name : names) {
+                shards[shardOfName(name, count)]->names.back().push_back(std::move(name));
+            }
+        }
+        else {
+            Shard& shard = *shards[directoryIndex * count / tree.size()];
+            shard.directories.push_back(directory);
+            shard.names.push_back(std::move(names));
+        }
+        ++directoryIndex;
+    }
+}
+
+// Sends 'request' to a shard that hasn't failed yet.
+bool ShardCoordinator::send(Shard& shard, const json& request) {
+    if (shard.failed) {
+        return false;
+    }
+
+    std::string error;
+    try {
+        if (!shard.worker.send(request)) {
+            error = "the worker process is not running";
+        }
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    if (!error.empty()) {
+        fail(shard, error);
+    }
+    return error.empty();
+}
+
+// Waits for a reply of 'replyType' from a shard that hasn't failed yet.
+bool ShardCoordinator::receive(Shard& shard, const std::string& replyType, json& reply) {
+    if (shard.failed) {
+        return false;
+    }
+
+    std::string error;
+    try {
+        if (!shard.worker.receive(reply)) {
+            error = "the worker process exited";
+        }
+        else if (reply.value("type", "") == "error") {
+            error = reply.value("message", "");
+        }
+        else if (reply.value("type", "") != replyType) {
+            error = "unexpected message from the worker process";
+        }
+    }
+    catch (const std::exception& e) {
+        error = e.what();
+    }
+
+    if (!error.empty()) {
+        fail(shard, error);
+    }
+    return error.empty();
+}
+
+// Marks the shard as failed, it takes no further part in the run.
+void ShardCoordinator::fail(Shard& shard, const std::string& error) {
+    std::cerr << "Shard " << shard.index + 1 << " failed: " << error << std::endl;
+    shard.failed = true;
+    shard.worker.stop();
+}
+
+// Merges the sort keys of all shards and numbers the files in merged order. By name hash the
+// keys decide, by subdirectory the shard comes first, which makes the numbers of each shard a
+// contiguous range starting at the count of all files numbered in earlier shards.
+void ShardCoordinator::assignNumbers() {
+    struct Entry {
+        const std::string* key;
+        size_t shard;
+        size_t index;
+    };
+
+    std::vector<Entry> entries;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        shard->numbers.assign(shard->keys.size(), 0);
+        for (size_t i = 0; i < shard->keys.size(); ++i) {
+            entries.push_back({ &shard->keys[i], shard->index, i });
+        }
+    }
+
+    const bool shardFirst = config.getShardMode() == Config::ShardMode::Subdirectory;
+    std::sort(entries.begin(), entries.end(), [shardFirst](const Entry& a, const Entry& b) {
+        if (shardFirst && a.shard != b.shard) {
+            return a.shard < b.shard;
+        }
+        int result = a.key->compare(*b.key);
+        if (result != 0) {
+            return result < 0;
+        }
+        return a.shard != b.shard ? a.shard < b.shard : a.index < b.index;
+        });
+
+    const auto& pattern = config.getStringAddPattern();
+    int step = pattern.formatConfig.step; if (step < 1) step = 1;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        shards[entries[i].shard]->numbers[entries[i].index] = pattern.formatConfig.start + static_cast<int>(i) * step;
+    }
+}
+
+// Checks the merged plan. A rename onto a name that another file in any shard keeps or gets as well,
+// or onto a file that is about to be deleted, is skipped. A skipped file keeps its current name, so
+// renames onto that name are skipped in turn. A rename onto the current name of a file that
+// is renamed itself, possibly in another shard, is dependent and has to go through a temporary name.
+void ShardCoordinator::checkCollisions() {
+    // A rename is identified by its shard and its index in the shard's files
+    std::unordered_map<std::string, int> targets;
+    std::unordered_map<std::string, std::vector<std::pair<size_t, size_t>>> renamesOnto;
+    std::vector<std::pair<size_t, size_t>> pending;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        for (size_t i = 0; i < shard->files.size(); ++i) {
+            const auto& [source, target] = shard->files[i];
+            ++targets[target];
+            if (source != target) {
+                renamesOnto[target].emplace_back(shard->index, i);
+                pending.emplace_back(shard->index, i);
+            }
+        }
+        for (const auto& path : shard->deletions) {
+            ++targets[path];
+        }
+    }
+
+    std::vector<std::vector<char>> skipped(shards.size());
+    for (const auto& shard : shards) {
+        skipped[shard->index].assign(shard->files.size(), 0);
+    }
+
+    while (!pending.empty()) {
+        auto [shardIndex, index] = pending.back();
+        pending.pop_back();
+
+        const auto& [source, target] = shards[shardIndex]->files[index];
+        if (skipped[shardIndex][index] || targets[target] < 2) {
+            continue;
+        }
+
+        skipped[shardIndex][index] = 1;
+        std::cerr << "Skipped: " << fromUtf8(source) << "  --->  " << fromUtf8(target) << ", another file has the same name." << std::endl;
+
+        // The current name stays taken, recheck the renames onto it
+        ++targets[source];
+        auto onto = renamesOnto.find(source);
+        if (onto != renamesOnto.end()) {
+            pending.insert(pending.end(), onto->second.begin(), onto->second.end());
+        }
+    }
+
+    std::unordered_set<std::string> sources;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        for (size_t i = 0; i < shard->files.size(); ++i) {
+            const auto& [source, target] = shard->files[i];
+            if (source == target) {
+                continue;
+            }
+            if (skipped[shard->index][i]) {
+                shard->skipped.push_back(i);
+                continue;
+            }
+            sources.insert(source);
+            ++renameCount;
+        }
+        deletionCount += shard->deletions.size();
+    }
+
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        size_t next = 0;
+        for (size_t i = 0; i < shard->files.size(); ++i) {
+            if (next < shard->skipped.size() && shard->skipped[next] == i) {
+                ++next;
+                continue;
+            }
+            const auto& [source, target] = shard->files[i];
+            if (source != target && sources.count(target)) {
+                shard->dependent.push_back(i);
+            }
+        }
+    }
+}
+
+// Displays the merged plan and asks for confirmation if enabled. Returns false if there is nothing to apply.
+bool ShardCoordinator::confirmChanges() {
+    if (!global.isConfirmEnabled()) {
+        return renameCount || deletionCount;
+    }
+
+    std::cout << "\n[Name changed files]" << std::endl;
+    size_t count = 1;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        size_t next = 0;
+        for (size_t i = 0; i < shard->files.size(); ++i) {
+            if (next < shard->skipped.size() && shard->skipped[next] == i) {
+                ++next;
+                continue;
+            }
+            const auto& [source, target] = shard->files[i];
+            if (source != target) {
+                std::cout << count++ << "." << fromUtf8(source) << "  --->  " << fromUtf8(target) << std::endl;
+            }
+        }
+    }
+    if (!renameCount) {
+        std::cout << "None\n" << std::endl;
+    }
+
+    std::cout << "\n[Files to delete]" << std::endl;
+    count = 1;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            continue;
+        }
+        for (const auto& path : shard->deletions) {
+            std::cout << count++ << ". " << fromUtf8(path) << std::endl;
+        }
+    }
+    if (!deletionCount) {
+        std::cout << "None\n" << std::endl;
+    }
+
+    if (!renameCount && !deletionCount) {
+        confirmWithMsg("No changes to apply, press any key to continue.");
+        return false;
+    }
+    confirmWithMsg("Press any key to apply changes.");
+    return true;
+}
+
+// Applies the plan in two rounds. Every shard first applies its independent renames and moves its
+// dependent ones to temporary names, only then do the temporary names take their targets, so a
+// rename onto a name vacated in another shard never runs before that shard has moved the file away.
+void ShardCoordinator::applyChanges() {
+    // Shards work on each round in parallel, a round ends once every shard has replied
+    for (const auto& shard : shards) {
+        send(*shard, { {"type", "stage"}, {"skipped", shard->skipped}, {"dependent", shard->dependent} });
+    }
+    json reply;
+    for (const auto& shard : shards) {
+        receive(*shard, "staged", reply);
+    }
+
+    for (const auto& shard : shards) {
+        send(*shard, { {"type", "finish"} });
+    }
+    for (const auto& shard : shards) {
+        if (receive(*shard, "done", reply)) {
+            shard->stats = reply;
+        }
+    }
+
+    size_t failedShards = 0;
+    for (const auto& shard : shards) {
+        if (shard->failed) {
+            ++failedShards;
+            continue;
+        }
+        std::cout << std::format("Shard {}: {} operations succeeded, {} failed, {} retries, up to {} in flight.",
+            shard->index + 1, shard->stats.value("succeeded", 0), shard->stats.value("failed", 0),
+            shard->stats.value("retried", 0), shard->stats.value("peak_concurrency", 0)) << std::endl;
+    }
+
+    if (failedShards) {
+        std::cerr << failedShards << " of " << shards.size() << " shards failed, see the messages above." << std::endl;
+    }
+}
+
+// Runs the profile through worker processes, see ShardCoordinator.h for the message sequence.
+void ShardCoordinator::run() {
+    if (!std::filesystem::is_directory(targetDirectory)) {
+        std::cerr << "Error: target directory does not exist or is not a valid directory." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::cout << "\nTarget Directory: " << targetDirectory << std::endl;
+
+    if (config.getPlanMemoryBudget() > 0) {
+        std::cerr << "plan_memory_mb is not supported together with shards, every shard is planned in memory." << std::endl;
+    }
+
+    const std::filesystem::path executable = executablePath();
+    if (executable.empty()) {
+        std::cerr << "Unable to locate the QuickRename executable to start worker processes." << std::endl;
+        return;
+    }
+
+#ifndef _WIN32
+    // A worker that exits early must not take the coordinator down with it
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    try {
+        createShards();
+    }
+    catch (const std::filesystem::filesystem_error& e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+
+    for (const auto& shard : shards) {
+        if (!shard->worker.start(executable)) {
+            std::cerr << "Shard " << shard->index + 1 << " failed: unable to start a worker process." << std::endl;
+            shard->failed = true;
+            continue;
+        }
+
+        json directories = json::array();
+        for (const auto& directory : shard->directories) {
+            directories.push_back(toUtf8(directory));
+        }
+        json request = {
+            {"type", "plan"},
+            {"profile", profile},
+            {"directories", directories},
+            {"names", shard->names}
+        };
+        send(*shard, request);
+        shard->names.clear();
+        shard->names.shrink_to_fit();
+    }
+    std::cout << "Started " << shards.size() << " worker processes." << std::endl;
+
+    // Workers plan in parallel, replies are collected in shard order
+    json reply;
+    for (const auto& shard : shards) {
+        if (receive(*shard, "keys", reply)) {
+            shard->keys = reply["keys"].get<std::vector<std::string>>();
+        }
+    }
+
+    assignNumbers();
+
+    for (const auto& shard : shards) {
+        send(*shard, { {"type", "number"}, {"numbers", shard->numbers} });
+    }
+    for (const auto& shard : shards) {
+        if (receive(*shard, "files", reply)) {
+            shard->files = reply["files"].get<std::vector<std::pair<std::string, std::string>>>();
+            shard->deletions = reply["delete"].get<std::vector<std::string>>();
+        }
+    }
+
+    checkCollisions();
+
+    if (!confirmChanges()) {
+        for (const auto& shard : shards) {
+            if (!shard->failed) {
+                shard->worker.send({ {"type", "abort"} });
+            }
+            shard->worker.stop();
+        }
+        return;
+    }
+
+    applyChanges();
+
+    for (const auto& shard : shards) {
+        shard->worker.stop();
+    }
+
+    if (!global.isExitWhenDoneEnabled()) {
+        confirmWithMsg("Changes applied, press any key ...");
+    }
+}
+
+// Worker side of the coordinator mode. Standard output carries the messages, so everything the
+// TaskHandler logs goes to standard error instead.
+int runShardWorker() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::ostream channel(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    auto send = [&](const json& message) {
+        channel << dumpMessage(message) << std::flush;
+        };
+
+    // Returns false if the coordinator aborted or went away
+    auto receive = [](json& message, const std::string& type) {
+        std::string line;
+        if (!std::getline(std::cin, line)) {
+            return false;
+        }
+        message = json::parse(line);
+        if (message.value("type", "") == "abort") {
+            return false;
+        }
+        if (message.value("type", "") != type) {
+            throw std::runtime_error("Expected a " + type + " message from the coordinator");
+        }
+        return true;
+        };
+
+    try {
+        json message;
+        if (!receive(message, "plan")) {
+            return EXIT_SUCCESS;
+        }
+
+        // The coordinator asks for confirmation, workers never wait for input
+        GlobalConfig global(json{ {"confirm", false}, {"exit_when_done", true} });
+        Config config(message["profile"]);
+        std::vector<std::filesystem::path> directories;
+        std::vector<std::filesystem::path> paths;
+        const json& names = message["names"];
+        for (size_t i = 0; i < message["directories"].size(); ++i) {
+            directories.push_back(fromUtf8(message["directories"][i].get<std::string>()));
+            for (const auto& name : names[i]) {
+                paths.push_back(directories.back() / fromUtf8(name.get<std::string>()));
+            }
+        }
+        TaskHandler taskHandler(global, config, directories, paths);
+
+        json keys = json::array();
+        for (const std::string& key : taskHandler.planShard()) {
+            keys.push_back(toHex(key));
+        }
+        send({ {"type", "keys"}, {"keys", keys} });
+
+        if (!receive(message, "number")) {
+            return EXIT_SUCCESS;
+        }
+        taskHandler.numberShard(message["numbers"].get<std::vector<int>>());
+
+        json files = json::array();
+        for (const File& file : taskHandler.getFiles()) {
+            files.push_back({ toUtf8(file.get_path()), toUtf8(file.get_new_name_path()) });
+        }
+        json deletions = json::array();
+        for (const File& file : taskHandler.getFilesToDelete()) {
+            deletions.push_back(toUtf8(file.get_path()));
+        }
+        send({ {"type", "files"}, {"files", files}, {"delete", deletions} });
+
+        if (!receive(message, "stage")) {
+            return EXIT_SUCCESS;
+        }
+        taskHandler.stageShard(message["skipped"].get<std::vector<size_t>>(), message["dependent"].get<std::vector<size_t>>());
+        send({ {"type", "staged"} });
+
+        // Files on temporary names are finished even without the coordinator, a target that
+        // is still taken gives the file its original name back
+        receive(message, "finish");
+        taskHandler.finishShard();
+
+        const ApplyScheduler::Result& stats = taskHandler.getApplyStats();
+        send({
+            {"type", "done"},
+            {"succeeded", stats.succeeded},
+            {"failed", stats.failed},
+            {"retried", stats.retried},
+            {"peak_concurrency", stats.peakConcurrency},
+            {"average_latency_ms", stats.averageLatencyMs}
+        });
+    }
+    catch (const std::exception& e) {
+        send({ {"type", "error"}, {"message", e.what()} });
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,7 +1,19 @@
 #include <QuickRename.h>
+#include <FileHash.h>
+#include <NameFormat.h>
+#include <Unicode.h>
+#include <ExternalSort.h>
 #include <iostream>
 #include <format>
 #include <regex>
+#include <execution>
+#include <numeric>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <sstream>
+#include <tuple>
 
 
 static void confirmWithMsg(const std::string& message) {
@@ -16,14 +28,31 @@ void TaskHandler::processFiles(const std::function<void(File&)>& action) {
     }
 }
 
+// Returns a suffix unique per run, used for temporary file names and the spill directory.
+static std::string makeTemporarySuffix() {
+    std::ostringstream suffix;
+    suffix << "." << std::hex << std::random_device{}() << ".quickrename";
+    return suffix.str();
+}
+
 // Constructor for TaskHandler, initializes configuration and retrieves file list.
-TaskHandler::TaskHandler(const GlobalConfig& globalConfig, const Config& config) : global(globalConfig), config(config) {
+TaskHandler::TaskHandler(const GlobalConfig& globalConfig, const Config& config) : global(globalConfig), config(config), scheduler(config.getApplyConcurrency()) {
     std::filesystem::path dir = std::filesystem::absolute(config.getTargetDir());
     if (std::filesystem::exists(dir) && std::filesystem::is_directory(dir)) {
         // targetDir exists and is a directory
         std::cout << "\nTarget Directory: " << dir << std::endl;
-        files = GetFileVector(dir);
-        getTasks();
+        targetDirectory = dir;
+
+        temporarySuffix = makeTemporarySuffix();
+
+        // With a memory budget the listing is streamed by the out-of-core task instead
+        if (config.getPlanMemoryBudget() > 0) {
+            tasks.emplace_back(std::bind(&TaskHandler::processOutOfCore, this));
+        }
+        else {
+            files = GetFileVector(dir);
+            getTasks();
+        }
     }
     else {
         // targetDir does not exist or is not a directory
@@ -32,19 +61,48 @@ TaskHandler::TaskHandler(const GlobalConfig& globalConfig, const Config& config)
     }
 }
 
-// Populate 'tasks' vector with function pointers based on configured actions.
-void TaskHandler::getTasks() {
+// Constructor for a shard worker, works on 'paths' as listed by the coordinator. 'directories' are
+// all directories of the target in numbering order. No tasks are queued, the coordinator drives the
+// worker through the shard methods instead.
+TaskHandler::TaskHandler(const GlobalConfig& globalConfig, const Config& config, const std::vector<std::filesystem::path>& directories, const std::vector<std::filesystem::path>& paths)
+    : global(globalConfig), config(config), scheduler(config.getApplyConcurrency()), shardDirectories(directories) {
+    targetDirectory = std::filesystem::absolute(config.getTargetDir());
+    temporarySuffix = makeTemporarySuffix();
+
+    files.reserve(paths.size());
+    for (const auto& path : paths) {
+        files.emplace_back(path, path.stem().string(), path.extension().string());
+    }
+}
+
+// Populate 'fileTasks' with the tasks that look at one file at a time.
+// These can run on any subset of the files, which the out-of-core task relies on.
+void TaskHandler::getFileTasks(std::vector<TaskFunction>& fileTasks) {
+
+    if (config.isUnicodeNormalizeEnabled()) {
+        fileTasks.emplace_back(std::bind(&TaskHandler::processUnicodeNormalization, this));
+    }
 
     if (!config.isUnwantedExtensionListEmpty()) {
-        tasks.emplace_back(std::bind(&TaskHandler::processUnwantedExtensions, this));
+        fileTasks.emplace_back(std::bind(&TaskHandler::processUnwantedExtensions, this));
     }
 
     if (!config.isStringDeleteListEmpty()) {
-        tasks.emplace_back(std::bind(&TaskHandler::processStringDeleteList, this));
+        fileTasks.emplace_back(std::bind(&TaskHandler::processStringDeleteList, this));
     }
 
     if (!config.isStringReplacePatternEmpty()) {
-        tasks.emplace_back(std::bind(&TaskHandler::processStringReplacePattern, this));
+        fileTasks.emplace_back(std::bind(&TaskHandler::processStringReplacePattern, this));
+    }
+}
+
+// Populate 'tasks' vector with function pointers based on configured actions.
+void TaskHandler::getTasks() {
+
+    getFileTasks(tasks);
+
+    if (!config.isDeleteDuplicatesEmpty()) {
+        tasks.emplace_back(std::bind(&TaskHandler::processDuplicates, this));
     }
 
     if (!config.isStringAddPatternEmpty()) {
@@ -90,59 +148,188 @@ std::vector<File> TaskHandler::GetFileVector(const std::filesystem::path& direct
     return directory_files;
 }
 
-// Deletes the specified file at the given filePath.
-// Returns true if the file is successfully deleted, false otherwise.
-void TaskHandler::deleteFile(const std::filesystem::path& filePath) {
-    try {
-        std::filesystem::remove(filePath);
-        std::cout << "File deleted: " << filePath << std::endl;
-    }
-    catch (const std::exception& e) {
-        // Handle and log any exceptions that occur during file deletion.
-        std::cerr << "Error deleting file " << filePath << ": " << e.what() << std::endl;
-    }
-}
-
 // Deletes all occurrences of the target substring in the input string.
 // Returns the modified string without the target substring.
 std::string TaskHandler::deleteSubString(const std::string& input, const std::string& target) {
-    std::string result;
+    return eraseAll(input, target, config.isIgnoreCaseEnabled());
+}
 
-    // Iterate through the input string to find and delete target substring
-    for (auto it = input.begin(); it != input.end();) {
-        auto pos = std::search(it, input.end(), target.begin(), target.end());
-        result.append(it, pos);
+// Returns the regex flags for patterns matched against file names.
+std::regex::flag_type TaskHandler::regexFlags() const {
+    return config.isIgnoreCaseEnabled() ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript;
+}
 
-        // If target substring found, move iterator past it
-        if (pos != input.end()) {
-            it = pos + target.length();
-        }
-        else {
-            // If target substring not found, exit the loop
-            it = input.end();
+// Unicode normalization task.
+// Converts names to NFC so decomposed names (e.g. from macOS shares) match the configured strings.
+void TaskHandler::processUnicodeNormalization() {
+    processFiles([&](File& file) {
+        std::string temp = normalizeNfc(file.get_new_name());
+        if (temp != file.get_new_name()) {
+            file.set_new_name(temp);
         }
-    }
-
-    return result;
+        });
 }
 
 // Delete files with unwanted extension.
 void TaskHandler::processUnwantedExtensions() {
     const std::vector<std::string>& unwantedExtensions = config.getUnwantedExtensionList();
 
+    auto isUnwanted = [&](const File& file) {
+        std::string extension = file.get_extension();
+        if (config.isUnicodeNormalizeEnabled()) {
+            extension = normalizeNfc(extension);
+        }
+        return std::any_of(unwantedExtensions.begin(), unwantedExtensions.end(), [&](const std::string& unwanted) {
+            return config.isIgnoreCaseEnabled() ? equalsIgnoreCase(extension, unwanted) : extension == unwanted;
+            });
+        };
+
     processFiles([&](File& file) {
-        if (std::find(unwantedExtensions.begin(), unwantedExtensions.end(), file.get_extension()) != unwantedExtensions.end())
+        if (isUnwanted(file))
             filesToDelete.emplace_back(file);
         });
 
     // Remove files with unwanted extensions from the files vector
-    files.erase(std::remove_if(files.begin(), files.end(), 
-        [&unwantedExtensions](const File& file) {
-            return std::find(unwantedExtensions.begin(), unwantedExtensions.end(), file.get_extension()) != unwantedExtensions.end();
-        }), files.end());
+    files.erase(std::remove_if(files.begin(), files.end(), isUnwanted), files.end());
 
 }
 
+// Duplicate content task.
+// Files are grouped by size first, only files sharing a size are read. Candidates are narrowed
+// down by a hash of their first and last block, then by a hash of the whole content, and every
+// duplicate is compared byte by byte with the kept file before it is scheduled for deletion.
+void TaskHandler::processDuplicates() {
+    const Config::DuplicatePolicy policy = config.getDuplicatePolicy();
+    constexpr std::uint64_t unreadable = UINT64_MAX;
+
+    using Groups = std::map<std::pair<std::uint64_t, std::uint64_t>, std::vector<size_t>>;
+
+    // Keeps only groups with more than one member and flattens them into a candidate list
+    auto collectCandidates = [](const Groups& groups) {
+        std::vector<size_t> candidates;
+        for (const auto& [key, members] : groups) {
+            if (members.size() > 1 && key.second != unreadable) {
+                candidates.insert(candidates.end(), members.begin(), members.end());
+            }
+        }
+        return candidates;
+        };
+
+    // Runs 'hasher' on all candidates in parallel and regroups them by (size, hash)
+    std::vector<std::uint64_t> sizes(files.size(), unreadable);
+    auto regroup = [&](const std::vector<size_t>& candidates, const std::function<std::uint64_t(size_t)>& hasher) {
+        std::vector<std::uint64_t> hashes(candidates.size());
+        std::transform(std::execution::par, candidates.begin(), candidates.end(), hashes.begin(), hasher);
+
+        Groups groups;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            groups[{ sizes[candidates[i]], hashes[i] }].push_back(candidates[i]);
+        }
+        return groups;
+        };
+
+    // Group by size, empty files are never treated as duplicates
+    std::for_each(std::execution::par, sizes.begin(), sizes.end(), [&](std::uint64_t& size) {
+        std::error_code ec;
+        auto fileSize = std::filesystem::file_size(files[&size - sizes.data()].get_path(), ec);
+        size = (ec || fileSize == 0) ? unreadable : static_cast<std::uint64_t>(fileSize);
+        });
+
+    Groups groups;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (sizes[i] != unreadable) {
+            groups[{ sizes[i], 0 }].push_back(i);
+        }
+    }
+
+    // Cheap partial hash, which already covers files of up to two blocks completely
+    groups = regroup(collectCandidates(groups), [&](size_t index) {
+        std::error_code ec;
+        std::uint64_t hash = hashFileBlocks(files[index].get_path(), sizes[index], ec);
+        return ec ? unreadable : hash;
+        });
+
+    std::vector<size_t> candidates;
+    for (size_t index : collectCandidates(groups)) {
+        if (sizes[index] > partialHashBlockSize * 2) {
+            candidates.push_back(index);
+        }
+    }
+
+    Groups fullHashGroups = regroup(candidates, [&](size_t index) {
+        std::error_code ec;
+        std::uint64_t hash = hashFile(files[index].get_path(), ec);
+        return ec ? unreadable : hash;
+        });
+
+    // Small files were fully hashed by the partial pass, keep their groups as they are
+    for (auto it = groups.begin(); it != groups.end(); ) {
+        it = (it->first.first > partialHashBlockSize * 2) ? groups.erase(it) : std::next(it);
+    }
+    groups.merge(fullHashGroups);
+
+    // Pick the file to keep in every group and pair it with the others. Each member's modification
+    // time is read once up front, a file whose time can't be read sorts after all others.
+    struct KeepKey {
+        bool timeUnknown = false;
+        std::filesystem::file_time_type time{};
+        size_t nameLength = 0;
+        std::string name;
+        size_t index = 0;
+
+        bool operator<(const KeepKey& other) const {
+            return std::tie(timeUnknown, time, nameLength, name) < std::tie(other.timeUnknown, other.time, other.nameLength, other.name);
+        }
+    };
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (auto& [key, members] : groups) {
+        if (members.size() < 2 || key.second == unreadable) {
+            continue;
+        }
+
+        std::vector<KeepKey> keys(members.size());
+        for (size_t i = 0; i < members.size(); ++i) {
+            KeepKey& keepKey = keys[i];
+            keepKey.index = members[i];
+            keepKey.name = files[members[i]].get_full_name();
+            keepKey.nameLength = keepKey.name.size();
+            if (policy == Config::DuplicatePolicy::KeepOldest) {
+                std::error_code ec;
+                keepKey.time = std::filesystem::last_write_time(files[members[i]].get_path(), ec);
+                keepKey.timeUnknown = static_cast<bool>(ec);
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            members[i] = keys[i].index;
+        }
+        for (size_t i = 1; i < members.size(); ++i) {
+            pairs.emplace_back(members[0], members[i]);
+        }
+    }
+
+    // Confirm every duplicate against the kept file, a hash match alone never deletes a file
+    std::vector<char> duplicate(files.size(), 0);
+    std::for_each(std::execution::par, pairs.begin(), pairs.end(), [&](const std::pair<size_t, size_t>& pair) {
+        if (isSameContent(files[pair.first].get_path(), files[pair.second].get_path())) {
+            duplicate[pair.second] = 1;
+        }
+        });
+
+    std::vector<File> remaining;
+    remaining.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (duplicate[i]) {
+            filesToDelete.emplace_back(std::move(files[i]));
+        }
+        else {
+            remaining.emplace_back(std::move(files[i]));
+        }
+    }
+    files = std::move(remaining);
+}
+
 // String delete task.
 // Processes the string delete list for each file, removing specified substrings from the new names.
 void TaskHandler::processStringDeleteList() {
@@ -176,7 +363,7 @@ void TaskHandler::processStringReplacePattern() {
         // Replace patterns listed in the string replace pattern list
         for (const auto& entry : stringReplaceList) {
             try {
-                temp = std::regex_replace(temp, std::regex(entry.first), entry.second);
+                temp = std::regex_replace(temp, std::regex(entry.first, regexFlags()), entry.second);
             }
             catch (const std::regex_error& e) {
                 std::cerr << "Regex Error: " << e.what() << std::endl;
@@ -190,26 +377,146 @@ void TaskHandler::processStringReplacePattern() {
         });
 }
 
-// Generates a new name based on the provided prefix, suffix, number width, and step.
-// Updates the number for the next generation based on the step value.
-std::string TaskHandler::generateNewName(const std::string& prefix, const std::string& suffix, const int& number_width, int& number, const int& step) {
-    std::ostringstream result;
+// Builds a key whose plain byte comparison yields natural order ("ep2" < "ep10").
+// Digit runs are encoded as a marker, the count of significant digits and the digits
+// themselves, so longer numbers compare greater without parsing them into integers.
+static std::string naturalSortKey(const std::string& name) {
+    std::string key;
+    key.reserve(name.size() + 8);
+
+    for (size_t i = 0; i < name.size();) {
+        if (name[i] >= '0' && name[i] <= '9') {
+            size_t end = i;
+            while (end < name.size() && name[end] >= '0' && name[end] <= '9') {
+                ++end;
+            }
+
+            // Skip leading zeros but keep a single zero for "0", "00", ...
+            size_t first = i;
+            while (first + 1 < end && name[first] == '0') {
+                ++first;
+            }
+
+            key += '\x01';
+            key += static_cast<char>(std::min<size_t>(end - first, 0xFF));
+            key.append(name, first, end - first);
+            i = end;
+        }
+        else {
+            // ASCII case folding, other bytes are compared as they are
+            char c = name[i];
+            key += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+            ++i;
+        }
+    }
+
+    return key;
+}
+
+// Computes the sort key of a file for the sort order of the string add pattern.
+// Numeric criteria are stored big-endian in front of the name key, so comparing keys
+// byte by byte orders files by the criterion first and by name second. Files whose criterion
+// can't be read get the largest key, so like files without a capture they are numbered last.
+std::string TaskHandler::sortKey(const File& file, const std::regex& captureObj) const {
+    using SortOrder = Config::SortOrder;
+    const std::string name = file.get_new_name();
+    std::uint64_t primary = 0;
+    std::string secondary;
+
+    switch (config.getStringAddPattern().sort) {
+    case SortOrder::Lexicographic:
+        secondary = name;
+        break;
+    case SortOrder::MTime: {
+        FileMetadata metadata;
+        if (queryFileMetadata(file.get_path(), MetadataMTime, metadata)) {
+            // Flip the sign bit so timestamps before 1970 still order correctly as unsigned
+            primary = static_cast<std::uint64_t>(metadata.mtime) ^ (std::uint64_t(1) << 63);
+        }
+        else {
+            primary = UINT64_MAX;
+        }
+        secondary = naturalSortKey(name);
+        break;
+    }
+    case SortOrder::Size: {
+        FileMetadata metadata;
+        primary = queryFileMetadata(file.get_path(), MetadataSize, metadata) ? metadata.size : UINT64_MAX;
+        secondary = naturalSortKey(name);
+        break;
+    }
+    case SortOrder::Capture: {
+        // Files without a match are numbered after all matching files
+        std::smatch match;
+        if (std::regex_search(name, match, captureObj)) {
+            secondary = naturalSortKey(match.size() > 1 ? match[1].str() : match[0].str());
+            secondary += '\0';
+        }
+        else {
+            primary = 1;
+        }
+        secondary += naturalSortKey(name);
+        break;
+    }
+    case SortOrder::None:
+        break;
+    default:
+        secondary = naturalSortKey(name);
+        break;
+    }
+
+    std::string key(sizeof(primary), '\0');
+    for (size_t i = 0; i < sizeof(primary); ++i) {
+        key[i] = static_cast<char>(primary >> (8 * (sizeof(primary) - 1 - i)));
+    }
+    key += secondary;
+    return key;
+}
+
+// Reorders 'files' according to the sort order of the string add pattern.
+// Each file gets its sort key computed once in parallel, then the keys are sorted in parallel
+// and the files are moved into place, so no name is re-parsed during comparisons.
+void TaskHandler::sortFiles() {
+    const auto& pattern = config.getStringAddPattern();
 
-    // Format new name using prefix, number, and suffix
-    result << prefix << std::setw(number_width) << std::setfill('0') << number << suffix;
+    struct SortKey {
+        std::string key;
+        size_t index = 0;
+    };
 
-    // Update number for the next generation based on the step
-    number += step;
+    std::vector<SortKey> keys(files.size());
+    std::regex captureObj;
+    if (pattern.sort == Config::SortOrder::Capture) {
+        captureObj = std::regex(pattern.sortMatch, regexFlags());
+    }
 
-    return result.str();
+    std::for_each(std::execution::par, keys.begin(), keys.end(), [&](SortKey& key) {
+        key.index = static_cast<size_t>(&key - keys.data());
+        key.key = sortKey(files[key.index], captureObj);
+        });
+
+    std::sort(std::execution::par, keys.begin(), keys.end(), [](const SortKey& a, const SortKey& b) {
+        int result = a.key.compare(b.key);
+        return result != 0 ? result < 0 : a.index < b.index;
+        });
+
+    std::vector<File> sorted;
+    sorted.reserve(files.size());
+    for (const SortKey& key : keys) {
+        sorted.emplace_back(std::move(files[key.index]));
+    }
+    files = std::move(sorted);
 }
 
 // Inserts the specified string at the given position in the original string.
+// Position counts code points, so a multi-byte character is never split.
 // If position is -1, appends the string to the end; if position is invalid, prepends the string to the original.
 void insertStringAtPosition(std::string& originalStr, const std::string& addString, int position) {
-    if (position >= 0 && position < originalStr.length()) {
+    size_t offset = position >= 0 ? codePointOffset(originalStr, static_cast<size_t>(position)) : std::string::npos;
+
+    if (offset < originalStr.length()) {
         // Insert at the specified position
-        originalStr.insert(position, addString);
+        originalStr.insert(offset, addString);
     }
     else if (position == -1) {
         // Append to the end
@@ -225,67 +532,136 @@ void insertStringAtPosition(std::string& originalStr, const std::string& addStri
 void TaskHandler::processStringAddPattern() {
     const auto& pattern = config.getStringAddPattern();
 
-    std::smatch match;
-    if (std::regex_search(pattern.format, match, std::regex("\\\\(\\d+)\\\\"))) {
-        int num = pattern.formatConfig.start;
-        int number_width = std::stoi(match[1].str());
-        int step = pattern.formatConfig.step; if (step < 1) step = 1;
-        std::string prefix = match.prefix();
-        std::string suffix = match.suffix();
-        std::string addString;
-        
-        if (pattern.match.empty()) {
-            // Process files and add new string based on numeric pattern
-            processFiles([&](File& file) {
-                std::string temp = file.get_new_name();
-                addString = generateNewName(prefix, suffix, number_width, num, step);
-                insertStringAtPosition(temp, addString, pattern.position);
-
-                if (temp != file.get_new_name()) {
-                    file.set_new_name(temp);
-                }
-                });
+    // Number files in the configured order instead of directory iteration order
+    if (pattern.sort != Config::SortOrder::None) {
+        sortFiles();
+    }
+
+    std::vector<FileMetadata> metadata;
+    std::vector<size_t> targets = addPatternTargets(metadata);
+
+    int step = pattern.formatConfig.step; if (step < 1) step = 1;
+    std::vector<int> numbers(targets.size());
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        numbers[i] = pattern.formatConfig.start + static_cast<int>(i) * step;
+    }
+
+    renderAddPattern(targets, metadata, numbers);
+}
+
+// Returns the indexes of the files the string is added to, all files if no pattern is set.
+// Metadata is only fetched for the fields the format references, in parallel and for these files only.
+// Files whose metadata can't be read are left out, so they are neither renamed nor numbered.
+std::vector<size_t> TaskHandler::addPatternTargets(std::vector<FileMetadata>& metadata) {
+    const auto& pattern = config.getStringAddPattern();
+    const NameFormat format(pattern.format);
+    std::vector<size_t> targets;
+    if (pattern.match.empty()) {
+        targets.resize(files.size());
+        std::iota(targets.begin(), targets.end(), size_t(0));
+    }
+    else {
+        std::regex matchObj(pattern.match, regexFlags());
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (std::regex_match(files[i].get_new_name(), matchObj)) {
+                targets.push_back(i);
+            }
         }
-        else {
-            std::regex matchObj(pattern.match);
-
-            // Process files and add new string based on numeric pattern if the file matches the specified pattern
-            processFiles([&](File& file) {
-                std::string temp = file.get_new_name();
-                if (std::regex_match(temp, matchObj)) {
-                    addString = generateNewName(prefix, suffix, number_width, num, step);
-                    insertStringAtPosition(temp, addString, pattern.position);
-                    if (temp != file.get_new_name()) {
-                        file.set_new_name(temp);
-                    }
-                }
-                });
+    }
+
+    metadata.assign(targets.size(), FileMetadata());
+    if (format.getRequiredFields() == MetadataNone) {
+        return targets;
+    }
+
+    std::vector<char> readable(targets.size(), 0);
+    std::for_each(std::execution::par, targets.begin(), targets.end(), [&](const size_t& index) {
+        size_t i = &index - targets.data();
+        readable[i] = queryFileMetadata(files[index].get_path(), format.getRequiredFields(), metadata[i]);
+        });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!readable[i]) {
+            std::cerr << "Skipped: " << files[targets[i]].get_path() << ", unable to read metadata." << std::endl;
+            continue;
         }
+        targets[kept] = targets[i];
+        metadata[kept] = metadata[i];
+        ++kept;
     }
-    else {
-        if (pattern.match.empty()) {
-            // Process files and add the specified string
-            processFiles([&](File& file) {
-                std::string temp = file.get_new_name();
-                insertStringAtPosition(temp, pattern.format, pattern.position);
-                if (temp != file.get_new_name()) {
-                    file.set_new_name(temp);
-                }
-                });
+    targets.resize(kept);
+    metadata.resize(kept);
+
+    return targets;
+}
+
+// Adds the formatted string to each file in 'targets', numbers[i] being the sequence number of targets[i].
+void TaskHandler::renderAddPattern(const std::vector<size_t>& targets, const std::vector<FileMetadata>& metadata, const std::vector<int>& numbers) {
+    const auto& pattern = config.getStringAddPattern();
+    const NameFormat format(pattern.format);
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        File& file = files[targets[i]];
+        std::string temp = file.get_new_name();
+        insertStringAtPosition(temp, format.render(file, metadata[i], numbers[i]), pattern.position);
+
+        if (temp != file.get_new_name()) {
+            file.set_new_name(temp);
         }
-        else {
-            std::regex matchObj(pattern.match);
-
-            // Process files and add the specified string if the file matches the specified pattern
-            processFiles([&](File& file) {
-                std::string temp = file.get_new_name();
-                if (std::regex_match(temp, matchObj)) {
-                    insertStringAtPosition(temp, pattern.format, pattern.position);
-                    if (temp != file.get_new_name()) {
-                        file.set_new_name(temp);
-                    }
-                }
-                });
+    }
+}
+
+// Collects the files with a new name into 'nameChangedFiles'.
+// A rename onto a name that another file keeps or gets as well, or onto a file that is about
+// to be deleted, is skipped so no file is overwritten. A skipped file keeps its current name,
+// so renames onto that name are skipped in turn.
+void TaskHandler::collectNameChangedFiles() {
+    std::unordered_map<std::string, int> targets;
+    std::unordered_map<std::string, std::vector<size_t>> renamesOnto;
+    for (size_t i = 0; i < files.size(); ++i) {
+        std::string target = files[i].get_new_name_path().string();
+        ++targets[target];
+        if (files[i].is_name_changed()) {
+            renamesOnto[target].push_back(i);
+        }
+    }
+    for (const File& file : filesToDelete) {
+        ++targets[file.get_path().string()];
+    }
+
+    std::vector<char> skipped(files.size(), 0);
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].is_name_changed()) {
+            pending.push_back(i);
+        }
+    }
+
+    while (!pending.empty()) {
+        size_t index = pending.back();
+        pending.pop_back();
+
+        const File& file = files[index];
+        if (skipped[index] || targets[file.get_new_name_path().string()] < 2) {
+            continue;
+        }
+
+        skipped[index] = 1;
+        std::cerr << std::format("Skipped: \"{}\"  --->  \"{}\", another file has the same name.", file.get_full_name(), file.get_new_full_name()) << std::endl;
+
+        // The current name stays taken, recheck the renames onto it
+        std::string source = file.get_path().string();
+        ++targets[source];
+        auto onto = renamesOnto.find(source);
+        if (onto != renamesOnto.end()) {
+            pending.insert(pending.end(), onto->second.begin(), onto->second.end());
+        }
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].is_name_changed() && !skipped[i]) {
+            nameChangedFiles.emplace_back(files[i]);
         }
     }
 }
@@ -296,14 +672,11 @@ void TaskHandler::showChanges() {
     std::cout << "\n[Name changed files]" << std::endl;
     int count = 1;
 
-    // Process files and display changes
-    processFiles([&](File& file) {
-        if (file.is_name_changed()) {
-            nameChangedFiles.emplace_back(file);
-            std::cout << std::format("{}.\"{}\"  --->  \"{}\"", count, file.get_full_name(), file.get_new_full_name()) << std::endl;
-            count++;
-        }
-        });
+    // Display changes
+    for (File& file : nameChangedFiles) {
+        std::cout << std::format("{}.\"{}\"  --->  \"{}\"", count, file.get_full_name(), file.get_new_full_name()) << std::endl;
+        count++;
+    }
 
     count = 1;
 
@@ -325,7 +698,9 @@ void TaskHandler::showChanges() {
 
 // Applies changes to file names and deletes specified files.
 void TaskHandler::applyChanges() {
-    
+
+    collectNameChangedFiles();
+
     // Ask for confirmation if enabled in the configuration
     if (global.isConfirmEnabled()) {
         showChanges();
@@ -338,28 +713,649 @@ void TaskHandler::applyChanges() {
             confirmWithMsg("Press any key to apply changes.");
         }
     }
-    else {
-        processFiles(
-            [&](File& file) {
-                if (file.is_name_changed()) {
-                    nameChangedFiles.emplace_back(file);
-                }
-            });
+
+    // A rename onto another file's current name has to wait until that file has moved away,
+    // those renames go through a temporary name after all independent renames are done
+    std::unordered_set<std::string> sources;
+    for (const File& file : nameChangedFiles) {
+        sources.insert(file.get_path().string());
     }
 
-    
+    std::vector<RenameOperation> renames;
+    std::vector<RenameOperation> dependentRenames;
+    for (const File& file : nameChangedFiles) {
+        RenameOperation rename{ file.get_path(), file.get_new_name_path(), {} };
+        (sources.count(rename.target.string()) ? dependentRenames : renames).push_back(std::move(rename));
+    }
 
     // Apply new names to files with name changes
-    for (File& file : nameChangedFiles) {
-        file.applyNewName();
-    }
+    moveFromTemporaryNames(stageRenames(renames, std::move(dependentRenames)));
 
     // Delete specified files
-    for (File& file : filesToDelete) {
-        deleteFile(file.get_path());
+    std::vector<std::filesystem::path> deletions;
+    for (const File& file : filesToDelete) {
+        deletions.push_back(file.get_path());
     }
+    runDeletions(deletions);
+
+    showApplyStats();
 
     if (!global.isExitWhenDoneEnabled()) {
         confirmWithMsg("Changes applied, press any key ...");
     }
 }
+
+// Applies 'renames' and moves 'dependentRenames' out of the way. Renames never replace a file, one
+// onto a name that still exists is treated as dependent. Returns the renames waiting on a temporary name.
+std::vector<TaskHandler::RenameOperation> TaskHandler::stageRenames(const std::vector<RenameOperation>& renames, std::vector<RenameOperation> dependentRenames) {
+    runRenames(renames, &dependentRenames);
+    return moveToTemporaryNames(dependentRenames);
+}
+
+// Renames files through the scheduler. If 'deferred' is set, renames onto a name that still
+// exists are not run but added to it, to be applied later through a temporary name.
+void TaskHandler::runRenames(const std::vector<RenameOperation>& renames, std::vector<RenameOperation>* deferred) {
+    std::vector<ApplyScheduler::Operation> operations;
+    operations.reserve(renames.size());
+
+    for (const RenameOperation& rename : renames) {
+        operations.emplace_back([this, &rename, deferred]() {
+            std::error_code ec;
+            renameNoReplace(rename.source, rename.target, ec);
+            if (ec == std::errc::file_exists && deferred) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                deferred->push_back(rename);
+                return std::error_code();
+            }
+            if (!ec) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cout << "Rename: " << rename.source << "  --->  " << rename.target << std::endl;
+            }
+            return ec;
+            });
+    }
+
+    ApplyScheduler::Result result = scheduler.run(operations);
+    for (const auto& [index, ec] : result.failures) {
+        std::cerr << std::filesystem::filesystem_error("rename", renames[index].source, renames[index].target, ec).what() << std::endl;
+    }
+    addApplyStats(result);
+}
+
+// First half of a rename onto a name that is being vacated: moves each source to a unique
+// temporary name. Returns the renames that were moved, with 'temporary' set.
+std::vector<TaskHandler::RenameOperation> TaskHandler::moveToTemporaryNames(const std::vector<RenameOperation>& renames) {
+    std::vector<RenameOperation> moved;
+    std::vector<ApplyScheduler::Operation> operations;
+    operations.reserve(renames.size());
+
+    for (const RenameOperation& rename : renames) {
+        operations.emplace_back([this, &rename, &moved]() {
+            RenameOperation temporary = rename;
+            temporary.temporary = rename.source;
+            temporary.temporary += temporarySuffix;
+
+            std::error_code ec;
+            renameNoReplace(temporary.source, temporary.temporary, ec);
+            if (!ec) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                moved.push_back(std::move(temporary));
+            }
+            return ec;
+            });
+    }
+
+    ApplyScheduler::Result result = scheduler.run(operations);
+    for (const auto& [index, ec] : result.failures) {
+        std::filesystem::path temporary = renames[index].source;
+        temporary += temporarySuffix;
+        std::cerr << std::filesystem::filesystem_error("rename", renames[index].source, temporary, ec).what() << std::endl;
+    }
+    addApplyStats(result);
+    return moved;
+}
+
+// Second half: moves each temporary name to its target. If the target still exists, because
+// the file holding it wasn't renamed after all, the file gets its original name back. If that
+// name has been taken meanwhile as well, the file stays on its temporary name and is reported.
+void TaskHandler::moveFromTemporaryNames(const std::vector<RenameOperation>& renames) {
+    std::vector<ApplyScheduler::Operation> operations;
+    operations.reserve(renames.size());
+
+    for (const RenameOperation& rename : renames) {
+        operations.emplace_back([this, &rename]() {
+            std::error_code ec;
+            renameNoReplace(rename.temporary, rename.target, ec);
+            if (!ec) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cout << "Rename: " << rename.source << "  --->  " << rename.target << std::endl;
+                return ec;
+            }
+            if (ec != std::errc::file_exists) {
+                return ec;
+            }
+
+            renameNoReplace(rename.temporary, rename.source, ec);
+            std::lock_guard<std::mutex> lock(logMutex);
+            if (!ec) {
+                std::cerr << "Skipped: " << rename.source << "  --->  " << rename.target << ", the target still exists." << std::endl;
+            }
+            else if (ec == std::errc::file_exists) {
+                std::cerr << "Skipped: " << rename.source << "  --->  " << rename.target << ", the target still exists and the original name was taken, the file was left at " << rename.temporary << std::endl;
+            }
+            return ec;
+            });
+    }
+
+    ApplyScheduler::Result result = scheduler.run(operations);
+    for (const auto& [index, ec] : result.failures) {
+        if (ec != std::errc::file_exists) {
+            std::cerr << std::filesystem::filesystem_error("rename", renames[index].temporary, renames[index].target, ec).what() << std::endl;
+        }
+    }
+    addApplyStats(result);
+}
+
+// Deletes files through the scheduler.
+void TaskHandler::runDeletions(const std::vector<std::filesystem::path>& paths) {
+    std::vector<ApplyScheduler::Operation> operations;
+    operations.reserve(paths.size());
+
+    for (const std::filesystem::path& path : paths) {
+        operations.emplace_back([this, &path]() {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            if (!ec) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cout << "File deleted: " << path << std::endl;
+            }
+            return ec;
+            });
+    }
+
+    ApplyScheduler::Result result = scheduler.run(operations);
+    for (const auto& [index, ec] : result.failures) {
+        std::cerr << "Error deleting file " << paths[index] << ": " << ec.message() << std::endl;
+    }
+    addApplyStats(result);
+}
+
+// Adds the result of one scheduler run to the totals shown after applying.
+void TaskHandler::addApplyStats(const ApplyScheduler::Result& result) {
+    double previousAttempts = static_cast<double>(applyStats.succeeded + applyStats.failed + applyStats.retried);
+    double attempts = static_cast<double>(result.succeeded + result.failed + result.retried);
+    if (previousAttempts + attempts > 0) {
+        applyStats.averageLatencyMs = (applyStats.averageLatencyMs * previousAttempts + result.averageLatencyMs * attempts) / (previousAttempts + attempts);
+    }
+
+    applyStats.succeeded += result.succeeded;
+    applyStats.failed += result.failed;
+    applyStats.retried += result.retried;
+    applyStats.peakConcurrency = std::max(applyStats.peakConcurrency, result.peakConcurrency);
+}
+
+// Summarizes how the scheduler adapted to the file system.
+void TaskHandler::showApplyStats() {
+    if (config.getApplyConcurrency().max > 1) {
+        std::cout << std::format("\nApplied with up to {} operations in flight, {:.1f} ms average latency, {} retries.",
+            applyStats.peakConcurrency, applyStats.averageLatencyMs, applyStats.retried) << std::endl;
+    }
+}
+
+// Out-of-core task, used instead of all other tasks if plan_memory_mb is set.
+// The listing is read in chunks that fit the memory budget. Each chunk runs through the per-file
+// tasks and is added to an external sort keyed by the numbering order. Merging it numbers files
+// in global order, and a second external sort by new name finds renames onto the same target
+// across the whole directory. Nothing is applied before the whole plan is known.
+void TaskHandler::processOutOfCore() {
+    std::error_code ec;
+    std::filesystem::path spillDirectory = config.getSpillDir().empty() ? std::filesystem::temp_directory_path(ec) : std::filesystem::path(config.getSpillDir());
+    spillDirectory /= "QuickRename" + temporarySuffix;
+
+    std::filesystem::create_directories(spillDirectory, ec);
+    if (ec) {
+        std::cerr << "Error creating spill directory " << spillDirectory << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    if (!config.isDeleteDuplicatesEmpty()) {
+        std::cerr << "delete_duplicates is not supported together with plan_memory_mb, duplicates are kept." << std::endl;
+    }
+
+    const size_t budget = config.getPlanMemoryBudget();
+    const auto& pattern = config.getStringAddPattern();
+    const bool addPattern = !config.isStringAddPatternEmpty();
+    bool temporaryNamesUsed = false;
+    bool failed = false;
+
+    try {
+        // Phase 1: run the per-file tasks chunk by chunk and sort by numbering order
+        ExternalSorter order(spillDirectory, "order", budget / 4);
+        ExternalSorter deletions(spillDirectory, "delete", budget / 8);
+        size_t deletionCount = 0;
+
+        std::vector<TaskFunction> fileTasks;
+        getFileTasks(fileTasks);
+
+        std::regex captureObj;
+        if (pattern.sort == Config::SortOrder::Capture) {
+            captureObj = std::regex(pattern.sortMatch, regexFlags());
+        }
+
+        const size_t chunkBudget = budget / 4;
+        size_t chunkBytes = 0;
+
+        auto flushChunk = [&]() {
+            for (const auto& task : fileTasks) {
+                task();
+            }
+
+            for (const File& file : filesToDelete) {
+                deletions.add({ file.get_full_name(), file.get_full_name(), {} });
+                ++deletionCount;
+            }
+
+            std::vector<std::string> keys(files.size());
+            if (addPattern && pattern.sort != Config::SortOrder::None) {
+                std::for_each(std::execution::par, keys.begin(), keys.end(), [&](std::string& key) {
+                    key = sortKey(files[&key - keys.data()], captureObj);
+                    });
+            }
+            for (size_t i = 0; i < files.size(); ++i) {
+                order.add({ std::move(keys[i]), files[i].get_full_name(), files[i].get_new_name() });
+            }
+
+            files.clear();
+            filesToDelete.clear();
+            chunkBytes = 0;
+            };
+
+        const bool ownDirectory = std::filesystem::equivalent(targetDirectory, std::filesystem::current_path());
+        for (const auto& entry : std::filesystem::directory_iterator(targetDirectory)) {
+            if (!entry.is_regular_file()) {
+                continue;
+            }
+
+            const std::filesystem::path& path = entry.path();
+            std::string fullname = path.filename().string();
+
+            // Skip config.json and QuickRename itself if target_dir is current directory
+            if (ownDirectory && (fullname == "config.json" || fullname == self_file_name)) {
+                continue;
+            }
+
+            files.emplace_back(path, path.stem().string(), path.extension().string());
+            chunkBytes += sizeof(File) + path.native().size() * sizeof(std::filesystem::path::value_type) + fullname.size() * 2;
+            if (chunkBytes >= chunkBudget) {
+                flushChunk();
+            }
+        }
+        flushChunk();
+
+        // Phase 2: number files in merged order and sort the results by new name
+        auto targets = std::make_unique<ExternalSorter>(spillDirectory, "target", budget / 4);
+        const NameFormat format(pattern.format);
+        std::regex matchObj;
+        if (addPattern && !pattern.match.empty()) {
+            matchObj = std::regex(pattern.match, regexFlags());
+        }
+        int num = pattern.formatConfig.start;
+        int step = pattern.formatConfig.step; if (step < 1) step = 1;
+
+        // Metadata is read in parallel for a batch of records, numbers are assigned in merged order
+        const size_t batchSize = std::max<size_t>(1024, budget / 4 / 512);
+        std::vector<File> pending;
+        std::vector<char> matched;
+        std::vector<char> readable;
+        std::vector<FileMetadata> metadata;
+
+        auto flushPending = [&]() {
+            matched.assign(pending.size(), 0);
+            readable.assign(pending.size(), 1);
+            metadata.assign(pending.size(), FileMetadata());
+            if (addPattern) {
+                std::for_each(std::execution::par, pending.begin(), pending.end(), [&](const File& file) {
+                    size_t i = &file - pending.data();
+                    matched[i] = pattern.match.empty() || std::regex_match(file.get_new_name(), matchObj);
+                    if (matched[i] && format.getRequiredFields() != MetadataNone) {
+                        readable[i] = queryFileMetadata(file.get_path(), format.getRequiredFields(), metadata[i]);
+                    }
+                    });
+            }
+
+            for (size_t i = 0; i < pending.size(); ++i) {
+                File& file = pending[i];
+                if (matched[i] && !readable[i]) {
+                    std::cerr << "Skipped: " << file.get_path() << ", unable to read metadata." << std::endl;
+                }
+                else if (matched[i]) {
+                    std::string temp = file.get_new_name();
+                    insertStringAtPosition(temp, format.render(file, metadata[i], num), pattern.position);
+                    if (format.hasCounter()) {
+                        num += step;
+                    }
+                    file.set_new_name(temp);
+                }
+
+                std::string target = file.get_new_full_name();
+                targets->add({ target, file.get_full_name(), target });
+            }
+            pending.clear();
+            };
+
+        order.merge([&](const SpillRecord& record) {
+            std::filesystem::path path = targetDirectory / record.source;
+            pending.emplace_back(path, path.stem().string(), path.extension().string());
+            pending.back().set_new_name(record.target);
+            if (pending.size() >= batchSize) {
+                flushPending();
+            }
+            });
+        flushPending();
+
+        // Files to delete keep their name until the end, nothing may be renamed onto them
+        deletions.merge([&](const SpillRecord& record) {
+            targets->add({ record.source, record.source, record.source });
+            });
+
+        // Phase 3: records with the same new name are adjacent now, write the conflict free plan.
+        // A skipped file keeps its current name, which is a taken target in the next pass, so
+        // renames onto it are skipped in turn. Passes repeat until one skips nothing.
+        const std::filesystem::path planPath = spillDirectory / "plan.run";
+        size_t renameCount = 0;
+        for (size_t pass = 1; ; ++pass) {
+            auto next = std::make_unique<ExternalSorter>(spillDirectory, "target" + std::to_string(pass), budget / 4);
+            RunWriter plan(planPath);
+            size_t skippedCount = 0;
+            std::vector<SpillRecord> group;
+            renameCount = 0;
+
+            auto flushGroup = [&]() {
+                for (const SpillRecord& record : group) {
+                    if (record.source != record.target && group.size() > 1) {
+                        std::cerr << std::format("Skipped: \"{}\"  --->  \"{}\", another file has the same name.", record.source, record.target) << std::endl;
+                        next->add({ record.source, record.source, record.source });
+                        ++skippedCount;
+                        continue;
+                    }
+
+                    if (record.source != record.target) {
+                        plan.write(record);
+                        ++renameCount;
+                    }
+                    next->add(record);
+                }
+                group.clear();
+                };
+
+            targets->merge([&](const SpillRecord& record) {
+                if (!group.empty() && group.front().key != record.key) {
+                    flushGroup();
+                }
+                group.push_back(record);
+                });
+            flushGroup();
+            plan.close();
+
+            if (!skippedCount) {
+                break;
+            }
+            targets = std::move(next);
+        }
+        targets.reset();
+
+        if (global.isConfirmEnabled()) {
+            std::cout << "\n[Name changed files]" << std::endl;
+            RunReader plan(planPath);
+            SpillRecord record;
+            for (size_t count = 1; plan.read(record); ++count) {
+                std::cout << std::format("{}.\"{}\"  --->  \"{}\"", count, record.source, record.target) << std::endl;
+            }
+        }
+
+        // Ask for confirmation if enabled in the configuration
+        if (global.isConfirmEnabled()) {
+            if (!renameCount) {
+                std::cout << "None\n" << std::endl;
+            }
+
+            std::cout << "\n[Files to delete]" << std::endl;
+            size_t count = 1;
+            deletions.merge([&](const SpillRecord& record) {
+                std::cout << std::format("{}. {}", count++, record.source) << std::endl;
+                });
+            if (!deletionCount) {
+                std::cout << "None\n" << std::endl;
+            }
+
+            if (!renameCount && !deletionCount) {
+                confirmWithMsg("No changes to apply, press any key to continue.");
+                std::filesystem::remove_all(spillDirectory, ec);
+                return;
+            }
+            confirmWithMsg("Press any key to apply changes.");
+        }
+
+        // Phase 4: apply the plan in batches, renames onto an existing name are deferred
+        auto forEachBatch = [&](const std::filesystem::path& path, const std::function<void(std::vector<RenameOperation>&)>& action) {
+            RunReader reader(path);
+            std::vector<RenameOperation> batch;
+            SpillRecord record;
+            while (reader.read(record)) {
+                batch.push_back({ targetDirectory / record.source, targetDirectory / record.target, {} });
+                if (batch.size() >= batchSize) {
+                    action(batch);
+                    batch.clear();
+                }
+            }
+            if (!batch.empty()) {
+                action(batch);
+            }
+            };
+
+        const std::filesystem::path deferredPath = spillDirectory / "deferred.run";
+        RunWriter deferredWriter(deferredPath);
+        forEachBatch(planPath, [&](std::vector<RenameOperation>& batch) {
+            std::vector<RenameOperation> deferred;
+            runRenames(batch, &deferred);
+            for (const RenameOperation& rename : deferred) {
+                deferredWriter.write({ {}, rename.source.filename().string(), rename.target.filename().string() });
+            }
+            });
+        deferredWriter.close();
+
+        // All deferred sources have to be moved away before any of them takes its new name
+        const std::filesystem::path temporaryPath = spillDirectory / "temporary.run";
+        RunWriter temporaryWriter(temporaryPath);
+        temporaryNamesUsed = true;
+        forEachBatch(deferredPath, [&](std::vector<RenameOperation>& batch) {
+            for (const RenameOperation& rename : moveToTemporaryNames(batch)) {
+                temporaryWriter.write({ {}, rename.source.filename().string(), rename.target.filename().string() });
+            }
+            });
+        temporaryWriter.close();
+
+        forEachBatch(temporaryPath, [&](std::vector<RenameOperation>& batch) {
+            for (RenameOperation& rename : batch) {
+                rename.temporary = rename.source;
+                rename.temporary += temporarySuffix;
+            }
+            moveFromTemporaryNames(batch);
+            });
+
+        // Delete specified files
+        std::vector<std::filesystem::path> batch;
+        deletions.merge([&](const SpillRecord& record) {
+            batch.push_back(targetDirectory / record.source);
+            if (batch.size() >= batchSize) {
+                runDeletions(batch);
+                batch.clear();
+            }
+            });
+        runDeletions(batch);
+
+        showApplyStats();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Out-of-core planning failed: " << e.what() << std::endl;
+        failed = true;
+
+        // Files may be left on a temporary name, the plan in the spill directory tells where they belong
+        if (temporaryNamesUsed && !restoreTemporaryNames()) {
+            std::cerr << "The plan was kept in " << spillDirectory << std::endl;
+            spillDirectory.clear();
+        }
+    }
+
+    if (!spillDirectory.empty()) {
+        std::filesystem::remove_all(spillDirectory, ec);
+    }
+
+    if (!global.isExitWhenDoneEnabled()) {
+        confirmWithMsg(failed ? "Changes were not fully applied, press any key ..." : "Changes applied, press any key ...");
+    }
+}
+
+// Gives every file still on a temporary name of this run its original name back.
+// Returns false if a file couldn't be restored, it is reported with its temporary name.
+bool TaskHandler::restoreTemporaryNames() {
+    std::error_code ec;
+    std::vector<std::filesystem::path> temporaries;
+    for (const auto& entry : std::filesystem::directory_iterator(targetDirectory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.size() > temporarySuffix.size() && name.ends_with(temporarySuffix)) {
+            temporaries.push_back(entry.path());
+        }
+    }
+    if (ec) {
+        std::cerr << "Error reading " << targetDirectory << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    bool restored = true;
+    for (const std::filesystem::path& temporary : temporaries) {
+        std::string name = temporary.filename().string();
+        std::filesystem::path source = temporary.parent_path() / name.substr(0, name.size() - temporarySuffix.size());
+
+        renameNoReplace(temporary, source, ec);
+        if (ec) {
+            std::cerr << "Unable to restore " << source << ", the file was left at " << temporary << ": " << ec.message() << std::endl;
+            restored = false;
+        }
+        else {
+            std::cout << "Restored: " << source << std::endl;
+        }
+    }
+    return restored;
+}
+
+// Shard worker planning step. Runs every task except numbering and returns a sort key for each
+// file the string add pattern applies to, in the order numberShard() expects the numbers.
+// Keys start with the big-endian index of the file's directory, so files are numbered
+// directory by directory when the coordinator merges the keys of all shards, and within a
+// directory by the sort order, or by current name if there is none.
+std::vector<std::string> TaskHandler::planShard() {
+    std::vector<TaskFunction> shardTasks;
+    getFileTasks(shardTasks);
+
+    // Only finds duplicates within the shard
+    if (!config.isDeleteDuplicatesEmpty()) {
+        shardTasks.emplace_back(std::bind(&TaskHandler::processDuplicates, this));
+    }
+
+    for (const auto& task : shardTasks) {
+        task();
+    }
+
+    std::vector<std::string> keys;
+    if (config.isStringAddPatternEmpty()) {
+        return keys;
+    }
+
+    const auto& pattern = config.getStringAddPattern();
+    std::regex captureObj;
+    if (pattern.sort == Config::SortOrder::Capture) {
+        captureObj = std::regex(pattern.sortMatch, regexFlags());
+    }
+
+    std::unordered_map<std::string, std::uint32_t> indices;
+    for (size_t i = 0; i < shardDirectories.size(); ++i) {
+        indices[shardDirectories[i].string()] = static_cast<std::uint32_t>(i);
+    }
+    // Only read from here on, the keys are built in parallel
+    const std::unordered_map<std::string, std::uint32_t>& directoryIndex = indices;
+
+    shardTargets = addPatternTargets(shardMetadata);
+    keys.resize(shardTargets.size());
+    std::for_each(std::execution::par, keys.begin(), keys.end(), [&](std::string& key) {
+        const File& file = files[shardTargets[&key - keys.data()]];
+        auto directory = directoryIndex.find(file.get_path().parent_path().string());
+        std::uint32_t index = directory != directoryIndex.end() ? directory->second : 0;
+
+        key.resize(sizeof(index));
+        for (size_t i = 0; i < sizeof(index); ++i) {
+            key[i] = static_cast<char>(index >> (8 * (sizeof(index) - 1 - i)));
+        }
+        // Without a sort order files are numbered by name, like in the out-of-core plan
+        key += pattern.sort != Config::SortOrder::None ? sortKey(file, captureObj) : file.get_full_name();
+        });
+
+    return keys;
+}
+
+// Shard worker numbering step, 'numbers' holds the global sequence number for each key of planShard().
+void TaskHandler::numberShard(const std::vector<int>& numbers) {
+    if (numbers.size() != shardTargets.size()) {
+        throw std::invalid_argument("Expected " + std::to_string(shardTargets.size()) + " sequence numbers, got " + std::to_string(numbers.size()));
+    }
+    renderAddPattern(shardTargets, shardMetadata, numbers);
+}
+
+const std::vector<File>& TaskHandler::getFiles() const {
+    return files;
+}
+
+const std::vector<File>& TaskHandler::getFilesToDelete() const {
+    return filesToDelete;
+}
+
+// Shard worker apply step, the indexes refer to getFiles().
+// Renames every changed file except 'skipped' and moves the 'dependent' renames to temporary names.
+void TaskHandler::stageShard(const std::vector<size_t>& skipped, const std::vector<size_t>& dependent) {
+    std::vector<char> flags(files.size(), 0);
+    for (size_t index : skipped) {
+        flags.at(index) = 1;
+    }
+    for (size_t index : dependent) {
+        flags.at(index) |= 2;
+    }
+
+    std::vector<RenameOperation> renames;
+    std::vector<RenameOperation> dependentRenames;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!files[i].is_name_changed() || (flags[i] & 1)) {
+            continue;
+        }
+        RenameOperation rename{ files[i].get_path(), files[i].get_new_name_path(), {} };
+        ((flags[i] & 2) ? dependentRenames : renames).push_back(std::move(rename));
+    }
+
+    stagedRenames = stageRenames(renames, std::move(dependentRenames));
+}
+
+// Shard worker finishing step, runs once every shard has staged its renames.
+// Moves the temporary names to their targets and deletes the files to delete.
+void TaskHandler::finishShard() {
+    moveFromTemporaryNames(stagedRenames);
+    stagedRenames.clear();
+
+    std::vector<std::filesystem::path> deletions;
+    for (const File& file : filesToDelete) {
+        deletions.push_back(file.get_path());
+    }
+    runDeletions(deletions);
+}
+
+const ApplyScheduler::Result& TaskHandler::getApplyStats() const {
+    return applyStats;
+}
@@ -0,0 +1,250 @@
+#include <Unicode.h>
+#include <Simd.h>
+#include <algorithm>
+#include <vector>
+#include <cwctype>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#pragma comment(lib, "Normaliz.lib")
+#endif
+
+
+namespace {
+    char asciiLower(char c) {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    bool asciiEqualsIgnoreCase(char a, char b) {
+        return asciiLower(a) == asciiLower(b);
+    }
+
+    // Decoded code points together with the byte offset each one starts at.
+    // 'offsets' has one extra entry holding the length of the input.
+    struct DecodedText {
+        std::u32string chars;
+        std::vector<size_t> offsets;
+    };
+
+    // Decodes UTF-8, bytes that don't form a valid sequence are kept as single code points.
+    DecodedText decodeUtf8(const std::string& text) {
+        DecodedText decoded;
+        decoded.chars.reserve(text.size());
+        decoded.offsets.reserve(text.size() + 1);
+
+        for (size_t i = 0; i < text.size();) {
+            unsigned char lead = static_cast<unsigned char>(text[i]);
+            size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+            char32_t codePoint = length == 1 ? lead : length == 2 ? (lead & 0x1F) : length == 3 ? (lead & 0x0F) : (lead & 0x07);
+
+            if (length == 0 || i + length > text.size()) {
+                length = 1;
+                codePoint = lead;
+            }
+            else {
+                for (size_t k = 1; k < length; ++k) {
+                    unsigned char next = static_cast<unsigned char>(text[i + k]);
+                    if ((next & 0xC0) != 0x80) {
+                        length = 1;
+                        codePoint = lead;
+                        break;
+                    }
+                    codePoint = (codePoint << 6) | (next & 0x3F);
+                }
+            }
+
+            decoded.chars += codePoint;
+            decoded.offsets.push_back(i);
+            i += length;
+        }
+
+        decoded.offsets.push_back(text.size());
+        return decoded;
+    }
+
+    // Maps every code point to lower case. The number of code points never changes,
+    // so positions in the folded text are positions in the original text.
+    void foldCase(std::u32string& chars) {
+#ifdef _WIN32
+        std::wstring wide;
+        wide.reserve(chars.size());
+        for (char32_t c : chars) {
+            if (c >= 0x10000) {
+                wide += static_cast<wchar_t>(0xD800 + ((c - 0x10000) >> 10));
+                wide += static_cast<wchar_t>(0xDC00 + ((c - 0x10000) & 0x3FF));
+            }
+            else {
+                wide += static_cast<wchar_t>(c);
+            }
+        }
+
+        std::wstring lower(wide.size(), L'\0');
+        int length = LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_LOWERCASE, wide.data(), static_cast<int>(wide.size()),
+            lower.data(), static_cast<int>(lower.size()), nullptr, nullptr, 0);
+        if (length != static_cast<int>(wide.size())) {
+            return;
+        }
+
+        // Lower casing maps surrogate pairs to surrogate pairs, decode in step with the input
+        size_t k = 0;
+        for (char32_t& c : chars) {
+            if (c >= 0x10000) {
+                c = 0x10000 + ((static_cast<char32_t>(lower[k] - 0xD800) << 10) | (lower[k + 1] - 0xDC00));
+                k += 2;
+            }
+            else {
+                c = lower[k++];
+            }
+        }
+#else
+        for (char32_t& c : chars) {
+            if (c < 0x80) {
+                c = static_cast<char32_t>(asciiLower(static_cast<char>(c)));
+            }
+            else {
+                c = static_cast<char32_t>(std::towlower(static_cast<std::wint_t>(c)));
+            }
+        }
+#endif
+    }
+}
+
+
+bool isAscii(std::string_view text) {
+    const char* data = text.data();
+    size_t size = text.size();
+    size_t i = 0;
+
+#ifdef QUICKRENAME_SSE2
+    // The sign bit of each byte ends up in the move mask
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(chunk) != 0) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < size; ++i) {
+        if (static_cast<unsigned char>(data[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string normalizeNfc(const std::string& text) {
+    if (isAscii(text)) {
+        return text;
+    }
+
+#ifdef _WIN32
+    int wideLength = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, text.data(), static_cast<int>(text.size()), nullptr, 0);
+    if (wideLength <= 0) {
+        return text;
+    }
+    std::wstring wide(wideLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, text.data(), static_cast<int>(text.size()), wide.data(), wideLength);
+
+    // The size returned by the first call is only an estimate, retry with the size the failed call asks for
+    int normalizedLength = NormalizeString(NormalizationC, wide.data(), wideLength, nullptr, 0);
+    std::wstring normalized;
+    while (normalizedLength > 0) {
+        normalized.assign(normalizedLength, L'\0');
+        normalizedLength = NormalizeString(NormalizationC, wide.data(), wideLength, normalized.data(), normalizedLength);
+        if (normalizedLength > 0) {
+            normalized.resize(normalizedLength);
+            break;
+        }
+        if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+            return text;
+        }
+        normalizedLength = -normalizedLength;
+    }
+    if (normalizedLength <= 0) {
+        return text;
+    }
+
+    int resultLength = WideCharToMultiByte(CP_UTF8, 0, normalized.data(), normalizedLength, nullptr, 0, nullptr, nullptr);
+    std::string result(resultLength, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, normalized.data(), normalizedLength, result.data(), resultLength, nullptr, nullptr);
+    return result;
+#else
+    return text;
+#endif
+}
+
+bool isNormalizationSupported() {
+#ifdef _WIN32
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+    if (isAscii(a) && isAscii(b)) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), asciiEqualsIgnoreCase);
+    }
+
+    DecodedText first = decodeUtf8(a);
+    DecodedText second = decodeUtf8(b);
+    foldCase(first.chars);
+    foldCase(second.chars);
+    return first.chars == second.chars;
+}
+
+std::string eraseAll(const std::string& text, const std::string& target, bool ignoreCase) {
+    if (target.empty()) {
+        return text;
+    }
+
+    std::string result;
+
+    // Byte search is exact for UTF-8 and also ignores case correctly if both sides are ASCII
+    if (!ignoreCase || (isAscii(text) && isAscii(target))) {
+        for (auto it = text.begin(); it != text.end();) {
+            auto pos = ignoreCase ? std::search(it, text.end(), target.begin(), target.end(), asciiEqualsIgnoreCase)
+                : std::search(it, text.end(), target.begin(), target.end());
+            result.append(it, pos);
+            it = (pos != text.end()) ? pos + target.length() : text.end();
+        }
+        return result;
+    }
+
+    // Search the folded code points and cut the matching byte ranges out of the original
+    DecodedText decoded = decodeUtf8(text);
+    DecodedText pattern = decodeUtf8(target);
+    foldCase(decoded.chars);
+    foldCase(pattern.chars);
+
+    size_t last = 0;
+    for (size_t pos = decoded.chars.find(pattern.chars); pos != std::u32string::npos; pos = decoded.chars.find(pattern.chars, last)) {
+        result.append(text, decoded.offsets[last], decoded.offsets[pos] - decoded.offsets[last]);
+        last = pos + pattern.chars.size();
+    }
+    result.append(text, decoded.offsets[last], std::string::npos);
+    return result;
+}
+
+size_t codePointOffset(const std::string& text, size_t index) {
+    if (isAscii(text)) {
+        return index <= text.size() ? index : std::string::npos;
+    }
+
+    // Count lead bytes, continuation bytes look like 10xxxxxx
+    size_t count = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80) {
+            if (count == index) {
+                return i;
+            }
+            ++count;
+        }
+    }
+    return count == index ? text.size() : std::string::npos;
+}